@@ -0,0 +1,86 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_SQL_SQLQUERY_H
+#define INCLUDED_SQL_SQLQUERY_H
+
+#include <sql/api.h>
+#include <memory>
+#include <string>
+
+namespace gr {
+  namespace sql {
+
+    /*!
+     * \brief Run a grsql SELECT without a flowgraph.
+     * \ingroup sql
+     *
+     * Samples come back in the same output format the sqlsource block
+     * would produce.  When no conversion or filtering is needed the samples
+     * can be handed out as a read-only memory mapped view of the file
+     * (map()); otherwise read() converts into a caller supplied buffer.
+     */
+    class SQL_API sqlquery
+    {
+     public:
+      typedef std::shared_ptr<sqlquery> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of sql::sqlquery.
+       *
+       * SAVEAS is ignored.
+       */
+      static sptr make(const std::string &sqlstring);
+
+      virtual ~sqlquery() {}
+
+      //! numpy style name of the output sample type (complex64, float32, int32, int16, uint8)
+      virtual std::string dtype() = 0;
+      //! Size in bytes of one output sample
+      virtual int itemsize() = 0;
+      //! Vector length (VLEN)
+      virtual int vlen() = 0;
+      //! Sample rate of the output after any RESAMPLE / DECIMATE / CENTER
+      virtual double sample_rate() = 0;
+      //! Samples in the selected time range, before any rate change
+      virtual long num_items() = 0;
+      //! Estimate of the output samples (num_items() scaled by the rate change)
+      virtual long estimated_output_items() = 0;
+
+      //! True when map() can be used (file layout is the output layout)
+      virtual bool zero_copy() = 0;
+
+      /*!
+       * \brief Next nitems samples as a read-only view of the mapped file.
+       *
+       * nitems is reduced to what's left in the range (0 at the end).  The
+       * returned pointer keeps the mapping alive.
+       */
+      virtual std::shared_ptr<const void> map(long &nitems) = 0;
+
+      //! Read (and convert / filter) up to nitems samples into dest.  Returns samples read, 0 at the end.
+      virtual long read(void *dest, long nitems) = 0;
+    };
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_SQLQUERY_H */
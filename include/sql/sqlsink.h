@@ -0,0 +1,62 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2017 ghostop14.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef INCLUDED_SQL_SQLSINK_H
+#define INCLUDED_SQL_SQLSINK_H
+
+#include <sql/api.h>
+#include <gnuradio/sync_block.h>
+
+namespace gr {
+  namespace sql {
+
+    /*!
+     * \brief Records a stream with INSERT INTO '<file>' ASDATATYPE ... SAMPLERATE ...
+     * \ingroup sql
+     *
+     * work() only copies into a ring buffer; a separate writer thread
+     * drains it to disk, so filesystem stalls are absorbed by the ring
+     * instead of backing up the flowgraph.  A SigMF style sidecar
+     * (name.sigmf-meta) is written next to each file so SELECT can read
+     * the data type and sample rate back.
+     */
+    class SQL_API sqlsink : virtual public gr::sync_block
+    {
+     public:
+      typedef std::shared_ptr<sqlsink> sptr;
+
+      /*!
+       * \brief Return a shared_ptr to a new instance of sql::sqlsink.
+       *
+       * igrcdatatype is the input type (same numbering as sqlsource).
+       */
+      static sptr make(const char *sqlstring, int igrcdatatype, int vlen=1);
+
+      //! Samples dropped because the ring buffer was full
+      virtual long dropped() = 0;
+      //! Samples written (or queued to be written)
+      virtual long recorded() = 0;
+    };
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_SQLSINK_H */
@@ -46,7 +46,12 @@ namespace gr {
        * class. sql::sqlsource::make is the public interface for
        * creating new instances.
        */
-      static sptr make(const char *sqlstring, int igrcdatatype);
+      static sptr make(const char *sqlstring, int igrcdatatype, int vlen=1);
+
+      //! REALTIME: number of times playback fell too far behind the clock and restarted pacing
+      virtual long underruns() = 0;
+      //! REALTIME: seconds behind the ideal playback clock at the last output (0 if on time)
+      virtual double drift() = 0;
     };
 
   } // namespace sql
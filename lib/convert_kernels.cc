@@ -0,0 +1,265 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "convert_kernels.h"
+#include "sqlsource_impl.h"
+#include <volk/volk.h>
+#include <climits>
+#include <cmath>
+#include <vector>
+
+namespace gr {
+  namespace sql {
+
+    // SELECT I / Q: one float out of each complex sample
+    template <>
+    void convert_samples<DATATYPE_COMPLEX, SELECT_I>(const unsigned char *in, long nsamples, void *out) {
+    	volk_32fc_deinterleave_real_32f((float *)out, (const lv_32fc_t *)in, nsamples);
+    }
+
+    template <>
+    void convert_samples<DATATYPE_COMPLEX, SELECT_Q>(const unsigned char *in, long nsamples, void *out) {
+    	volk_32fc_deinterleave_imag_32f((float *)out, (const lv_32fc_t *)in, nsamples);
+    }
+
+    // hackrf_transfer signed 8-bit I/Q (scaling mirrored from csdr).  UHD's SC8 is the same layout.
+    template <>
+    void convert_samples<DATATYPE_SIGNED8, SELECT_STAR>(const unsigned char *in, long nsamples, void *out) {
+    	volk_8i_s32f_convert_32f((float *)out, (const int8_t *)in, (float)SCHAR_MAX, 2*nsamples);
+    }
+
+    template <>
+    void convert_samples<DATATYPE_SC8, SELECT_STAR>(const unsigned char *in, long nsamples, void *out) {
+    	volk_8i_s32f_convert_32f((float *)out, (const int8_t *)in, (float)SCHAR_MAX, 2*nsamples);
+    }
+
+    struct unsigned8_table
+    {
+    	float value[UCHAR_MAX + 1];
+
+    	unsigned8_table() {
+    		for (int b=0;b<=UCHAR_MAX;b++)
+    			value[b] = ((float)b)/((float)UCHAR_MAX/2.0)-1.0;
+    	}
+    };
+
+    // rtl_sdr unsigned 8-bit I/Q (scaling mirrored from csdr)
+    template <>
+    void convert_samples<DATATYPE_UNSIGNED8, SELECT_STAR>(const unsigned char *in, long nsamples, void *out) {
+    	// Only 256 possible values, so look them up.  (Built once, thread-safe, shards share it.)
+    	static const unsigned8_table lut;
+    	float *floatout = (float *)out;
+
+    	for (long j=0;j<2*nsamples;j++)
+    		floatout[j] = lut.value[in[j]];
+    }
+
+    // UHD / BladeRF interleaved int16 I/Q
+    template <>
+    void convert_samples<DATATYPE_SC16, SELECT_STAR>(const unsigned char *in, long nsamples, void *out) {
+    	volk_16i_s32f_convert_32f((float *)out, (const int16_t *)in, (float)SHRT_MAX, 2*nsamples);
+    }
+
+    // 3 bytes per sample, little-endian nibble packing:
+    // I = b0 | (b1 & 0x0F) << 8, Q = (b1 >> 4) | b2 << 4.  Each is a signed 12-bit value.
+    template <>
+    void convert_samples<DATATYPE_SC12, SELECT_STAR>(const unsigned char *in, long nsamples, void *out) {
+    	float *floatout = (float *)out;
+    	const float scale = 1.0f / 2047.0f;
+    	const unsigned char *p = in;
+
+    	for (long j=0;j<nsamples;j++) {
+    		int16_t ival = (int16_t)((uint16_t)(p[0] | ((p[1] & 0x0F) << 8)) << 4) >> 4;
+    		int16_t qval = (int16_t)((uint16_t)((p[1] >> 4) | (p[2] << 4)) << 4) >> 4;
+    		floatout[2*j] = (float)ival * scale;
+    		floatout[2*j+1] = (float)qval * scale;
+    		p += 3;
+    	}
+    }
+
+    convert_kernel get_convert_kernel(int datatype, int selectaction) {
+    	if (selectaction == SELECT_I)
+    		return &convert_samples<DATATYPE_COMPLEX, SELECT_I>;
+
+    	if (selectaction == SELECT_Q)
+    		return &convert_samples<DATATYPE_COMPLEX, SELECT_Q>;
+
+    	switch (datatype) {
+    	case DATATYPE_SIGNED8:
+    		return &convert_samples<DATATYPE_SIGNED8, SELECT_STAR>;
+    	case DATATYPE_UNSIGNED8:
+    		return &convert_samples<DATATYPE_UNSIGNED8, SELECT_STAR>;
+    	case DATATYPE_SC16:
+    		return &convert_samples<DATATYPE_SC16, SELECT_STAR>;
+    	case DATATYPE_SC12:
+    		return &convert_samples<DATATYPE_SC12, SELECT_STAR>;
+    	case DATATYPE_SC8:
+    		return &convert_samples<DATATYPE_SC8, SELECT_STAR>;
+    	}
+
+    	// complex / float / int / short / byte go out exactly as recorded
+    	return NULL;
+    }
+
+    // Integer samples of NCOMP components (1 real, 2 I/Q): clipped if any component sits at
+    // lo or hi, zero if they all are 0.  Branch-free so the compiler can vectorize it.
+    template <class T, int NCOMP>
+    static inline void integer_health(const T *in, long nsamples, T lo, T hi, unsigned char *flags) {
+    	for (long j=0;j<nsamples;j++) {
+    		unsigned char clipped = 0;
+    		unsigned char zero = 1;
+
+    		for (int c=0;c<NCOMP;c++) {
+    			T v = in[NCOMP*j+c];
+    			clipped |= (unsigned char)((v == lo) | (v == hi));
+    			zero &= (unsigned char)(v == 0);
+    		}
+
+    		flags[j] = (unsigned char)((zero * HEALTH_ZERO) | ((clipped & (zero ^ 1)) * HEALTH_CLIPPED));
+    	}
+    }
+
+    // Float samples: no full scale to clip at, so NaN / inf and zeros
+    template <int NCOMP>
+    static inline void float_health(const float *in, long nsamples, unsigned char *flags) {
+    	for (long j=0;j<nsamples;j++) {
+    		unsigned char nonfinite = 0;
+    		unsigned char zero = 1;
+
+    		for (int c=0;c<NCOMP;c++) {
+    			float v = in[NCOMP*j+c];
+    			nonfinite |= (unsigned char)!std::isfinite(v);
+    			zero &= (unsigned char)(v == 0.0f);
+    		}
+
+    		flags[j] = (unsigned char)((zero * HEALTH_ZERO) | (nonfinite * HEALTH_NONFINITE));
+    	}
+    }
+
+    template <>
+    void health_flags<DATATYPE_COMPLEX>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	float_health<2>((const float *)in, nsamples, flags);
+    }
+
+    template <>
+    void health_flags<DATATYPE_FLOAT>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	float_health<1>((const float *)in, nsamples, flags);
+    }
+
+    template <>
+    void health_flags<DATATYPE_INT>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	integer_health<int32_t, 1>((const int32_t *)in, nsamples, INT_MIN, INT_MAX, flags);
+    }
+
+    template <>
+    void health_flags<DATATYPE_SHORT>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	integer_health<int16_t, 1>((const int16_t *)in, nsamples, SHRT_MIN, SHRT_MAX, flags);
+    }
+
+    template <>
+    void health_flags<DATATYPE_BYTE>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	integer_health<int8_t, 1>((const int8_t *)in, nsamples, SCHAR_MIN, SCHAR_MAX, flags);
+    }
+
+    // HackRF and UHD SC8
+    template <>
+    void health_flags<DATATYPE_SIGNED8>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	integer_health<int8_t, 2>((const int8_t *)in, nsamples, SCHAR_MIN, SCHAR_MAX, flags);
+    }
+
+    template <>
+    void health_flags<DATATYPE_UNSIGNED8>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	integer_health<uint8_t, 2>(in, nsamples, 0, UCHAR_MAX, flags);
+    }
+
+    template <>
+    void health_flags<DATATYPE_SC16>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	integer_health<int16_t, 2>((const int16_t *)in, nsamples, SHRT_MIN, SHRT_MAX, flags);
+    }
+
+    template <>
+    void health_flags<DATATYPE_SC12>(const unsigned char *in, long nsamples, unsigned char *flags) {
+    	// Same unpacking as the conversion, full scale is -2048 / 2047
+    	const unsigned char *p = in;
+
+    	for (long j=0;j<nsamples;j++) {
+    		int16_t ival = (int16_t)((uint16_t)(p[0] | ((p[1] & 0x0F) << 8)) << 4) >> 4;
+    		int16_t qval = (int16_t)((uint16_t)((p[1] >> 4) | (p[2] << 4)) << 4) >> 4;
+    		unsigned char clipped = (unsigned char)((ival == -2048) | (ival == 2047) | (qval == -2048) | (qval == 2047));
+    		unsigned char zero = (unsigned char)((ival == 0) & (qval == 0));
+
+    		flags[j] = (unsigned char)((zero * HEALTH_ZERO) | (clipped * HEALTH_CLIPPED));
+    		p += 3;
+    	}
+    }
+
+    health_kernel get_health_kernel(int datatype) {
+    	switch (datatype) {
+    	case DATATYPE_COMPLEX:
+    		return &health_flags<DATATYPE_COMPLEX>;
+    	case DATATYPE_FLOAT:
+    		return &health_flags<DATATYPE_FLOAT>;
+    	case DATATYPE_INT:
+    		return &health_flags<DATATYPE_INT>;
+    	case DATATYPE_SHORT:
+    		return &health_flags<DATATYPE_SHORT>;
+    	case DATATYPE_BYTE:
+    		return &health_flags<DATATYPE_BYTE>;
+    	case DATATYPE_SIGNED8:
+    	case DATATYPE_SC8:
+    		return &health_flags<DATATYPE_SIGNED8>;
+    	case DATATYPE_UNSIGNED8:
+    		return &health_flags<DATATYPE_UNSIGNED8>;
+    	case DATATYPE_SC16:
+    		return &health_flags<DATATYPE_SC16>;
+    	case DATATYPE_SC12:
+    		return &health_flags<DATATYPE_SC12>;
+    	}
+
+    	return NULL;
+    }
+
+    void prime_convert_kernels() {
+    	// Big enough for 64 of the widest sample in and out
+    	std::vector<unsigned char> in(64 * 8, 0);
+    	std::vector<unsigned char> out(64 * 8, 0);
+    	int selects[] = { SELECT_STAR, SELECT_I, SELECT_Q };
+
+    	for (int datatype=DATATYPE_COMPLEX;datatype<=DATATYPE_SC8;datatype++) {
+    		for (size_t s=0;s<sizeof(selects)/sizeof(selects[0]);s++) {
+    			convert_kernel convert = get_convert_kernel(datatype, selects[s]);
+
+    			if (convert)
+    				convert(&in[0], 64, &out[0]);
+    		}
+
+    		health_kernel health = get_health_kernel(datatype);
+
+    		if (health)
+    			health(&in[0], 64, &out[0]);
+    	}
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
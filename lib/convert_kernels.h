@@ -0,0 +1,69 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_SQL_CONVERT_KERNELS_H
+#define INCLUDED_SQL_CONVERT_KERNELS_H
+
+#include <sql/api.h>
+
+namespace gr {
+  namespace sql {
+
+    /*
+     * Converts nsamples recorded samples (datatypesize bytes each) into nsamples
+     * output items.  One is picked per (data type, SELECT) when the query is parsed,
+     * so the read path never branches on either and each inner loop is a single
+     * VOLK call or a tight branch-free loop.
+     */
+    typedef void (*convert_kernel)(const unsigned char *in, long nsamples, void *out);
+
+    template <int DATATYPE, int SELECT>
+    void convert_samples(const unsigned char *in, long nsamples, void *out);
+
+    // NULL if the recording is already in the output format (read straight into the output)
+    SQL_API convert_kernel get_convert_kernel(int datatype, int selectaction);
+
+    /*
+     * SELECT HEALTH: one flag byte per recorded sample, straight from the raw bytes so
+     * integer full scale is matched exactly.  A sample that's all zeros is a dropout and
+     * never also counted as clipped (ex: rtl_sdr 0,0).
+     */
+#define HEALTH_CLIPPED 1
+#define HEALTH_ZERO 2
+#define HEALTH_NONFINITE 4
+
+    typedef void (*health_kernel)(const unsigned char *in, long nsamples, unsigned char *flags);
+
+    template <int DATATYPE>
+    void health_flags(const unsigned char *in, long nsamples, unsigned char *flags);
+
+    health_kernel get_health_kernel(int datatype);
+
+    /*
+     * Runs every conversion and health kernel once on a few zeros.  VOLK picks each
+     * kernel's implementation (and reads its config) on the kernel's first call, so
+     * grsql --serve does this once before it forks workers.  Exported for grsql.
+     */
+    SQL_API void prime_convert_kernels();
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_CONVERT_KERNELS_H */
@@ -0,0 +1,515 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "dsp_kernels.h"
+#include <volk/volk.h>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace gr {
+  namespace sql {
+
+#define KAISER_BETA 7.0
+
+    static double bessel_i0(double x) {
+    	// Power series, converges quickly for the beta values we use.
+    	double sum = 1.0;
+    	double term = 1.0;
+    	double halfx = x / 2.0;
+
+    	for (int k=1;k<50;k++) {
+    		term = term * (halfx / (double)k) * (halfx / (double)k);
+    		sum = sum + term;
+
+    		if (term < sum * 1e-12)
+    			break;
+    	}
+
+    	return sum;
+    }
+
+    std::vector<float> design_lowpass(double gain, double sampling_freq, double cutoff_freq,
+    		double transition_width, int ntaps) {
+    	if (ntaps <= 0) {
+    		// Attenuation for a Kaiser window given beta, then the usual windowed-sinc length estimate
+    		double atten = KAISER_BETA / 0.1102 + 8.7;
+    		ntaps = (int)(atten * sampling_freq / (22.0 * transition_width));
+    	}
+
+    	// Keep it odd so it's symmetric around a center tap
+    	if ((ntaps & 1) == 0)
+    		ntaps++;
+
+    	if (ntaps < 3)
+    		ntaps = 3;
+
+    	std::vector<float> taps(ntaps);
+    	int m = (ntaps - 1) / 2;
+    	double fwt0 = 2.0 * M_PI * cutoff_freq / sampling_freq;
+    	double i0beta = bessel_i0(KAISER_BETA);
+    	double sum = 0.0;
+
+    	for (int n=-m;n<=m;n++) {
+    		double r = (double)n / (double)m;
+    		double w = bessel_i0(KAISER_BETA * sqrt(1.0 - r*r)) / i0beta;
+    		double h;
+
+    		if (n == 0)
+    			h = fwt0 / M_PI;
+    		else
+    			h = sin(n * fwt0) / (n * M_PI);
+
+    		taps[n + m] = (float)(h * w);
+    		sum = sum + taps[n + m];
+    	}
+
+    	// Normalize to the requested DC gain
+    	for (int n=0;n<ntaps;n++)
+    		taps[n] = (float)(taps[n] * gain / sum);
+
+    	return taps;
+    }
+
+    long gcd_long(long a, long b) {
+    	while (b != 0) {
+    		long t = a % b;
+    		a = b;
+    		b = t;
+    	}
+
+    	return a;
+    }
+
+    static inline void dot_prod(gr_complex *result, const gr_complex *in, const float *taps, unsigned int n) {
+    	volk_32fc_32f_dot_prod_32fc(result, in, taps, n);
+    }
+
+    static inline void dot_prod(float *result, const float *in, const float *taps, unsigned int n) {
+    	volk_32f_x2_dot_prod_32f(result, in, taps, n);
+    }
+
+    template <class T>
+    std::vector<float> rational_resampler<T>::design_taps(int iinterp, int idecim, int ntaps) {
+    	// Same band edges gnuradio's rational_resampler picks with fractional_bw = 0.4
+    	double halfband = 0.5;
+    	double rate = (double)iinterp / (double)idecim;
+    	double trans_width;
+    	double mid_transition_band;
+
+    	if (rate >= 1.0) {
+    		trans_width = halfband - 0.4;
+    		mid_transition_band = halfband - trans_width / 2.0;
+    	}
+    	else {
+    		trans_width = rate * (halfband - 0.4);
+    		mid_transition_band = rate * halfband - trans_width / 2.0;
+    	}
+
+    	return design_lowpass((double)iinterp, (double)iinterp, mid_transition_band, trans_width, ntaps);
+    }
+
+    template <class T>
+    rational_resampler<T>::rational_resampler(int iinterp, int idecim, const std::vector<float> &taps) {
+    	interp = iinterp;
+    	decim = idecim;
+    	phase = 0;
+    	nextwindow = 0;
+    	outpos = 0;
+
+    	tapsperphase = (int)((taps.size() + interp - 1) / interp);
+
+    	phasetaps.resize(interp);
+
+    	for (int p=0;p<interp;p++) {
+    		phasetaps[p].assign(tapsperphase, 0.0f);
+
+    		for (int k=0;k<tapsperphase;k++) {
+    			size_t tapindex = p + k * interp;
+
+    			if (tapindex < taps.size())
+    				phasetaps[p][tapsperphase - 1 - k] = taps[tapindex];
+    		}
+    	}
+
+    	// Prime with zeros so the first output lines up with the first input sample.
+    	history.assign(tapsperphase - 1, T(0));
+    }
+
+    template <class T>
+    long rational_resampler<T>::input_needed(long noutput) {
+    	long nin = (noutput * decim) / interp;
+
+    	if (nin < 1)
+    		nin = 1;
+
+    	return nin;
+    }
+
+    template <class T>
+    void rational_resampler<T>::push(const T *in, long nin) {
+    	if (nin <= 0)
+    		return;
+
+    	// Compact the output queue if everything's been pulled
+    	if (outpos >= outqueue.size()) {
+    		outqueue.clear();
+    		outpos = 0;
+    	}
+
+    	history.insert(history.end(), in, in + nin);
+
+    	long windowstart = nextwindow;
+    	long worklen = (long)history.size();
+    	T result;
+
+    	while ((windowstart + tapsperphase) <= worklen) {
+    		dot_prod(&result, &history[windowstart], &phasetaps[phase][0], tapsperphase);
+    		outqueue.push_back(result);
+
+    		phase = phase + decim;
+    		windowstart = windowstart + phase / interp;
+    		phase = phase % interp;
+    	}
+
+    	// Whatever wasn't stepped past is history for the next push.  When decimating
+    	// the last step can run past what we have, so carry the remainder forward.
+    	long consumed = (windowstart < worklen) ? windowstart : worklen;
+    	history.erase(history.begin(), history.begin() + consumed);
+    	nextwindow = windowstart - consumed;
+    }
+
+    template <class T>
+    long rational_resampler<T>::pull(T *out, long nmax) {
+    	long n = available();
+
+    	if (n > nmax)
+    		n = nmax;
+
+    	if (n > 0) {
+    		memcpy((void *)out, (const void *)&outqueue[outpos], n * sizeof(T));
+    		outpos = outpos + n;
+    	}
+
+    	return n;
+    }
+
+    freq_xlating_decimator::freq_xlating_decimator(int idecim, const std::vector<float> &lowpasstaps, double centerfreq, double samplerate) {
+    	decim = idecim;
+    	ntaps = (int)lowpasstaps.size();
+    	nextwindow = 0;
+    	outpos = 0;
+    	renormcount = 0;
+
+    	// Rotate the low pass up to the channel: h[k] * e^(j*2*pi*fc*k/fs)
+    	revtaps.resize(ntaps);
+    	double w = 2.0 * M_PI * centerfreq / samplerate;
+
+    	for (int k=0;k<ntaps;k++) {
+    		revtaps[ntaps - 1 - k] = gr_complex(lowpasstaps[k] * cos(w * k), lowpasstaps[k] * sin(w * k));
+    	}
+
+    	// Then each decimated output gets mixed down by the phase of its newest input sample
+    	phasor = gr_complex(1.0, 0.0);
+    	phaseinc = gr_complex(cos(-w * decim), sin(-w * decim));
+
+    	history.assign(ntaps - 1, gr_complex(0.0, 0.0));
+    }
+
+    long freq_xlating_decimator::input_needed(long noutput) {
+    	long nin = noutput * decim;
+
+    	if (nin < 1)
+    		nin = 1;
+
+    	return nin;
+    }
+
+    void freq_xlating_decimator::push(const gr_complex *in, long nin) {
+    	if (nin <= 0)
+    		return;
+
+    	if (outpos >= outqueue.size()) {
+    		outqueue.clear();
+    		outpos = 0;
+    	}
+
+    	history.insert(history.end(), in, in + nin);
+
+    	long windowstart = nextwindow;
+    	long worklen = (long)history.size();
+    	gr_complex result;
+
+    	while ((windowstart + ntaps) <= worklen) {
+    		volk_32fc_x2_dot_prod_32fc(&result, &history[windowstart], &revtaps[0], ntaps);
+    		outqueue.push_back(result * phasor);
+
+    		phasor = phasor * phaseinc;
+    		windowstart = windowstart + decim;
+
+    		// Keep the mixer from drifting in amplitude over long runs
+    		if (++renormcount >= 512) {
+    			phasor = phasor / std::abs(phasor);
+    			renormcount = 0;
+    		}
+    	}
+
+    	long consumed = (windowstart < worklen) ? windowstart : worklen;
+    	history.erase(history.begin(), history.begin() + consumed);
+    	nextwindow = windowstart - consumed;
+    }
+
+    long freq_xlating_decimator::pull(gr_complex *out, long nmax) {
+    	long n = available();
+
+    	if (n > nmax)
+    		n = nmax;
+
+    	if (n > 0) {
+    		memcpy((void *)out, (const void *)&outqueue[outpos], n * sizeof(gr_complex));
+    		outpos = outpos + n;
+    	}
+
+    	return n;
+    }
+
+    void prime_dsp_kernels() {
+    	std::vector<gr_complex> a(64, gr_complex(0.0f, 0.0f));
+    	std::vector<gr_complex> b(64, gr_complex(0.0f, 0.0f));
+    	std::vector<float> f(64, 0.0f);
+    	gr_complex cresult;
+    	float fresult;
+
+    	volk_32fc_x2_dot_prod_32fc(&cresult, &a[0], &b[0], 64);
+    	volk_32fc_32f_dot_prod_32fc(&cresult, &a[0], &f[0], 64);
+    	volk_32f_x2_dot_prod_32f(&fresult, &f[0], &f[0], 64);
+    	volk_32fc_x2_multiply_32fc(&a[0], &a[0], &b[0], 64);
+    }
+
+    bool is_power_of_2(long n) {
+    	return (n > 0) && ((n & (n - 1)) == 0);
+    }
+
+    long next_power_of_2(long n) {
+    	long p = 1;
+
+    	while (p < n)
+    		p = p << 1;
+
+    	return p;
+    }
+
+    fft_filterbank::fft_filterbank(int idecim, const std::vector<float> &lowpasstaps, const std::vector<double> &centers, double isamplerate) {
+    	decim = idecim;
+    	samplerate = isamplerate;
+
+    	// Overlap has to cover the filter and stay a multiple of the decimation so each
+    	// block's output lands on the decimated sample grid.
+    	int ntaps = (int)lowpasstaps.size();
+    	overlap = ((ntaps - 1 + decim - 1) / decim) * decim;
+
+    	long minsize = 4 * (long)overlap;
+    	if (minsize < 2 * (long)decim)
+    		minsize = 2 * (long)decim;
+    	if (minsize < 4096)
+    		minsize = 4096;
+
+    	fftsize = (int)next_power_of_2(minsize);
+    	chanfftsize = fftsize / decim;
+    	hop = fftsize - overlap;
+
+    	fwdfft.reset(new gr::fft::fft_complex_fwd(fftsize));
+    	revfft.reset(new gr::fft::fft_complex_rev(chanfftsize));
+
+    	// Filter frequency response at the block FFT size
+    	gr_complex *fftin = fwdfft->get_inbuf();
+    	memset((void *)fftin, 0, fftsize * sizeof(gr_complex));
+    	for (int k=0;k<ntaps;k++)
+    		fftin[k] = gr_complex(lowpasstaps[k], 0.0);
+    	fwdfft->execute();
+    	filterresponse.assign(fwdfft->get_outbuf(), fwdfft->get_outbuf() + fftsize);
+
+    	for (size_t c=0;c<centers.size();c++) {
+    		long bin = (long)floor(centers[c] * (double)fftsize / samplerate + 0.5);
+    		double residual = centers[c] - (double)bin * samplerate / (double)fftsize;
+
+    		bin = ((bin % fftsize) + fftsize) % fftsize;
+    		centerbin.push_back((int)bin);
+
+    		double w = -2.0 * M_PI * residual * (double)decim / samplerate;
+    		finephasor.push_back(gr_complex(1.0, 0.0));
+    		finephaseinc.push_back(gr_complex(cos(w), sin(w)));
+    	}
+
+    	outqueues.resize(centers.size());
+
+    	inbuffer.assign(fftsize, gr_complex(0.0, 0.0));
+    	infill = overlap;   // start with a zero history like the FIR paths
+    	blockstart = -overlap;
+    	totalin = 0;
+    	totalout = 0;
+    }
+
+    void fft_filterbank::push(const gr_complex *in, long nin) {
+    	totalin = totalin + nin;
+
+    	while (nin > 0) {
+    		long n = fftsize - infill;
+
+    		if (n > nin)
+    			n = nin;
+
+    		memcpy((void *)&inbuffer[infill], (const void *)in, n * sizeof(gr_complex));
+    		infill = infill + n;
+    		in = in + n;
+    		nin = nin - n;
+
+    		if (infill == fftsize) {
+    			process_block();
+
+    			// Slide the overlap down for the next block
+    			memmove((void *)&inbuffer[0], (const void *)&inbuffer[hop], overlap * sizeof(gr_complex));
+    			infill = overlap;
+    			blockstart = blockstart + hop;
+    		}
+    	}
+    }
+
+    void fft_filterbank::flush() {
+    	if (infill > overlap) {
+    		memset((void *)&inbuffer[infill], 0, (fftsize - infill) * sizeof(gr_complex));
+    		process_block();
+
+    		memmove((void *)&inbuffer[0], (const void *)&inbuffer[hop], overlap * sizeof(gr_complex));
+    		infill = overlap;
+    		blockstart = blockstart + hop;
+    	}
+
+    	// The padded block ran past the end of the input.  Drop what the zeros produced.
+    	long wanted = (totalin + decim - 1) / decim;
+    	long excess = totalout - wanted;
+
+    	if (excess > 0) {
+    		for (size_t c=0;c<outqueues.size();c++) {
+    			std::vector<gr_complex> &q = outqueues[c];
+    			q.resize(((long)q.size() > excess) ? q.size() - excess : 0);
+    		}
+
+    		totalout = wanted;
+    	}
+    }
+
+    void fft_filterbank::process_block() {
+    	memcpy((void *)fwdfft->get_inbuf(), (const void *)&inbuffer[0], fftsize * sizeof(gr_complex));
+    	fwdfft->execute();
+
+    	const gr_complex *spectrum = fwdfft->get_outbuf();
+    	gr_complex *chanin = revfft->get_inbuf();
+    	const gr_complex *chanout = revfft->get_outbuf();
+
+    	int halfchan = chanfftsize / 2;
+    	int discard = overlap / decim;
+    	int keep = hop / decim;
+    	float scale = 1.0f / (float)fftsize;
+
+    	for (size_t c=0;c<centerbin.size();c++) {
+    		// Bins around the channel center (negative frequencies wrap) times the filter response
+    		for (int m=0;m<chanfftsize;m++) {
+    			int k = (m < halfchan) ? m : (m - chanfftsize + fftsize);
+    			chanin[m] = spectrum[(k + centerbin[c]) % fftsize] * filterresponse[k];
+    		}
+
+    		revfft->execute();
+
+    		// The bin shift is relative to the start of this block.  Line it up with the
+    		// stream: e^(-j*2*pi*bin*blockstart/N)
+    		long phaseindex = ((long)centerbin[c] * (blockstart % fftsize)) % fftsize;
+    		if (phaseindex < 0)
+    			phaseindex += fftsize;
+    		double a = -2.0 * M_PI * (double)phaseindex / (double)fftsize;
+    		gr_complex blockphase = gr_complex(cos(a), sin(a)) * scale;
+
+    		std::vector<gr_complex> &q = outqueues[c];
+    		size_t start = q.size();
+    		q.resize(start + keep);
+
+    		for (int i=0;i<keep;i++) {
+    			q[start + i] = chanout[discard + i] * blockphase * finephasor[c];
+    			finephasor[c] = finephasor[c] * finephaseinc[c];
+    		}
+
+    		finephasor[c] = finephasor[c] / std::abs(finephasor[c]);
+    	}
+
+    	totalout = totalout + keep;
+    }
+
+    template class rational_resampler<gr_complex>;
+    template class rational_resampler<float>;
+
+    iq_histogram::iq_histogram(int ibins, float irange) {
+    	bins = ibins;
+    	range = irange;
+    	scale = (float)bins / (2.0f * range);
+    	counts.assign((size_t)bins * (size_t)bins + 1, 0);
+    }
+
+    void iq_histogram::add(const gr_complex *in, long n) {
+    	if ((long)indices.size() < n)
+    		indices.resize(n);
+
+    	const float *iq = (const float *)in;
+    	const int32_t overflow = bins * bins;
+
+    	for (long j=0;j<n;j++) {
+    		// float compare first so huge values / NaN never reach the int conversion
+    		float fi = (iq[2*j] + range) * scale;
+    		float fq = (iq[2*j+1] + range) * scale;
+    		bool inside = (fi >= 0.0f) & (fi < (float)bins) & (fq >= 0.0f) & (fq < (float)bins);
+    		int32_t bi = inside ? (int32_t)fi : 0;
+    		int32_t bq = inside ? (int32_t)fq : 0;
+
+    		indices[j] = inside ? (bq * bins + bi) : overflow;
+    	}
+
+    	for (long j=0;j<n;j++)
+    		counts[indices[j]]++;
+    }
+
+    uint64_t iq_histogram::merge_into(std::vector<uint64_t> &total) {
+    	size_t nbins = (size_t)bins * (size_t)bins;
+
+    	for (size_t b=0;b<nbins;b++) {
+    		total[b] = total[b] + counts[b];
+    		counts[b] = 0;
+    	}
+
+    	uint64_t outside = counts[nbins];
+    	counts[nbins] = 0;
+
+    	return outside;
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
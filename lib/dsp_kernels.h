@@ -0,0 +1,211 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_SQL_DSP_KERNELS_H
+#define INCLUDED_SQL_DSP_KERNELS_H
+
+#include <sql/api.h>
+#include <gnuradio/types.h>
+#include <gnuradio/fft/fft.h>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace gr {
+  namespace sql {
+
+    // Kaiser windowed-sinc low pass (same design approach as firdes::low_pass with KAISER, beta 7).
+    // If ntaps is 0 the length is computed from the transition width.
+    SQL_API std::vector<float> design_lowpass(double gain, double sampling_freq, double cutoff_freq,
+    		double transition_width, int ntaps=0);
+
+    long gcd_long(long a, long b);
+
+    /*
+     * Anything that sits between the file reader and the output: push input as it's
+     * read, pull whatever output is ready.
+     */
+    template <class T>
+    class stream_filter
+    {
+    public:
+    	virtual ~stream_filter() {}
+
+    	// Number of input samples needed to produce roughly noutput more samples
+    	virtual long input_needed(long noutput) = 0;
+
+    	virtual void push(const T *in, long nin) = 0;
+    	virtual long available() = 0;
+    	virtual long pull(T *out, long nmax) = 0;
+    };
+
+    /*
+     * Polyphase rational resampler (interp / decim).  Input is pushed in whatever
+     * chunk sizes the reader has and the filter history carries across pushes, so
+     * read block boundaries and work() calls don't matter.  Output is queued
+     * internally and pulled by the caller.
+     */
+    template <class T>
+    class SQL_API rational_resampler : public stream_filter<T>
+    {
+    protected:
+    	int interp;
+    	int decim;
+    	int tapsperphase;
+    	// polyphase taps, each phase stored reversed so the dot product runs over ascending samples.
+    	std::vector< std::vector<float> > phasetaps;
+
+    	std::vector<T> history;  // samples not yet fully consumed from the last push
+    	int phase;
+    	long nextwindow;  // start of the next filter window in history
+
+    	std::vector<T> outqueue;
+    	size_t outpos;
+
+    public:
+    	rational_resampler(int iinterp, int idecim, const std::vector<float> &taps);
+
+    	static std::vector<float> design_taps(int iinterp, int idecim, int ntaps=0);
+
+    	int interpolation() { return interp; }
+    	int decimation() { return decim; }
+    	int ntaps() { return tapsperphase * interp; }
+
+    	long input_needed(long noutput);
+
+    	void push(const T *in, long nin);
+    	long available() { return (long)(outqueue.size() - outpos); }
+    	long pull(T *out, long nmax);
+    };
+
+    /*
+     * Frequency translating decimator for CENTER / BANDWIDTH.  The low pass taps are
+     * rotated up to the channel so a single decimating FIR pass does the filtering,
+     * and the mix back down to baseband only happens on the decimated output.
+     */
+    class SQL_API freq_xlating_decimator : public stream_filter<gr_complex>
+    {
+    protected:
+    	int decim;
+    	int ntaps;
+    	std::vector<gr_complex> revtaps;  // bandpass taps, reversed
+
+    	std::vector<gr_complex> history;
+    	long nextwindow;
+
+    	gr_complex phasor;      // output mixer
+    	gr_complex phaseinc;
+    	long renormcount;
+
+    	std::vector<gr_complex> outqueue;
+    	size_t outpos;
+
+    public:
+    	freq_xlating_decimator(int idecim, const std::vector<float> &lowpasstaps, double centerfreq, double samplerate);
+
+    	long input_needed(long noutput);
+
+    	void push(const gr_complex *in, long nin);
+    	long available() { return (long)(outqueue.size() - outpos); }
+    	long pull(gr_complex *out, long nmax);
+    };
+
+    bool is_power_of_2(long n);
+    long next_power_of_2(long n);
+
+    /*
+     * FFT (fast convolution / overlap-save) filterbank for CHANNELS AT.  One forward
+     * FFT per block of input feeds every channel: each channel picks the bins around its
+     * center, applies the low pass response and does a small inverse FFT that is already
+     * decimated.  Any offset between the requested center and the nearest bin is taken out
+     * afterwards at the decimated rate, so centers are exact.
+     */
+    class SQL_API fft_filterbank
+    {
+    protected:
+    	int decim;
+    	int fftsize;
+    	int chanfftsize;
+    	int overlap;   // samples carried from block to block (multiple of decim)
+    	int hop;       // new input samples per block
+    	double samplerate;
+
+    	// FFTW plans from gr::fft, made once per filterbank
+    	std::unique_ptr<gr::fft::fft_complex_fwd> fwdfft;
+    	std::unique_ptr<gr::fft::fft_complex_rev> revfft;
+    	std::vector<gr_complex> filterresponse;
+
+    	std::vector<int> centerbin;
+    	std::vector<gr_complex> finephasor;
+    	std::vector<gr_complex> finephaseinc;
+
+    	std::vector<gr_complex> inbuffer;  // time domain block being filled
+    	int infill;
+    	long blockstart;   // input sample index of inbuffer[0], for bin mixing phase
+    	long totalin;      // input samples pushed
+    	long totalout;     // samples put on each channel's queue
+
+    	std::vector< std::vector<gr_complex> > outqueues;
+
+    	void process_block();
+
+    public:
+    	fft_filterbank(int idecim, const std::vector<float> &lowpasstaps, const std::vector<double> &centers, double isamplerate);
+
+    	int num_channels() { return (int)centerbin.size(); }
+
+    	void push(const gr_complex *in, long nin);
+    	// End of input: runs the partial block (zero padded) so each channel ends up with
+    	// ceil(input / decim) samples, the same as the single channel FIR path.
+    	void flush();
+    	// Each channel's output since the last call is in outqueue(ch).  Clear it once written.
+    	std::vector<gr_complex> &outqueue(int ch) { return outqueues[ch]; }
+    };
+
+    /*
+     * 2-D I/Q occupancy histogram for SELECT CONSTELLATION, bins x bins over +/- range on
+     * both axes.  Bin indices are computed for a whole block first (a loop the compiler can
+     * vectorize); samples outside the range land in one extra overflow bin so the count loop
+     * doesn't branch.  32-bit counts, so callers merge into a wider total every so often.
+     */
+    class iq_histogram
+    {
+    protected:
+    	int bins;
+    	float range;
+    	float scale;
+    	std::vector<uint32_t> counts;   // bins * bins (row = Q bin, column = I bin) + overflow
+    	std::vector<int32_t> indices;
+
+    public:
+    	iq_histogram(int ibins, float irange);
+
+    	void add(const gr_complex *in, long n);
+    	// Adds the counts into total (bins * bins) and returns / clears the out of range count
+    	uint64_t merge_into(std::vector<uint64_t> &total);
+    };
+
+    // First call of each VOLK kernel the filters and searches use (see prime_convert_kernels)
+    SQL_API void prime_dsp_kernels();
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_DSP_KERNELS_H */
@@ -0,0 +1,521 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT, sync_file_range
+#endif
+
+#include "file_io.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <cerrno>
+
+namespace gr {
+  namespace sql {
+
+#define PAGEMASK (~((long)DIRECTIOALIGNMENT - 1))
+
+    file_reader::file_reader(std::string ifilename, int ipolicy, long ireadahead) {
+    	filename = ifilename;
+    	policy = ipolicy;
+    	readahead = (ireadahead > 0) ? ireadahead : DEFAULTREADAHEAD;
+
+    	fp = NULL;
+    	directfd = -1;
+    	directbuffer = NULL;
+    	directbufferstart = 0;
+    	directbufferlen = 0;
+    	pos = 0;
+    	advisedto = 0;
+    	droppedto = 0;
+
+#ifdef O_DIRECT
+    	if (policy == IOPOLICY_DIRECT) {
+    		directfd = open(filename.c_str(), O_RDONLY | O_DIRECT);
+
+    		if (directfd >= 0) {
+    			if (posix_memalign((void **)&directbuffer, DIRECTIOALIGNMENT, DIRECTIOBLOCKSIZE) != 0) {
+    				::close(directfd);
+    				directfd = -1;
+    				directbuffer = NULL;
+    			}
+    		}
+
+    		if (directfd < 0) {
+    			// Some filesystems (tmpfs, some network mounts) don't do O_DIRECT
+    			std::cout << "WARNING: O_DIRECT isn't available for " << filename << ".  Using drop-behind instead." << std::endl;
+    			policy = IOPOLICY_DROPBEHIND;
+    		}
+    	}
+#else
+    	if (policy == IOPOLICY_DIRECT) {
+    		std::cout << "WARNING: O_DIRECT isn't available on this platform.  Using drop-behind instead." << std::endl;
+    		policy = IOPOLICY_DROPBEHIND;
+    	}
+#endif
+
+    	if (directfd < 0) {
+    		fp = fopen(filename.c_str(), "rb");
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    		if (fp && (policy != IOPOLICY_NORMAL)) {
+    			posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_SEQUENTIAL);
+    		}
+#endif
+    	}
+    }
+
+    file_reader::~file_reader() {
+#ifdef POSIX_FADV_DONTNEED
+    	if (fp && (policy == IOPOLICY_DROPBEHIND) && (pos > droppedto)) {
+    		posix_fadvise(fileno(fp), droppedto, pos - droppedto, POSIX_FADV_DONTNEED);
+    	}
+#endif
+
+    	if (fp)
+    		fclose(fp);
+
+    	if (directfd >= 0)
+    		::close(directfd);
+
+    	if (directbuffer)
+    		free(directbuffer);
+    }
+
+    int file_reader::fd() {
+    	if (fp)
+    		return fileno(fp);
+
+    	return directfd;
+    }
+
+    bool file_reader::seek(long newpos) {
+    	pos = newpos;
+    	advisedto = newpos;
+    	droppedto = newpos & PAGEMASK;
+
+    	if (fp) {
+    		if (fseek(fp, newpos, SEEK_SET) != 0)
+    			return false;
+    	}
+
+    	advise();
+
+    	return true;
+    }
+
+    void file_reader::advise() {
+    	if (!fp || (policy == IOPOLICY_NORMAL))
+    		return;
+
+#ifdef POSIX_FADV_WILLNEED
+    	// Keep the readahead window topped up once we're halfway through it
+    	if ((pos + readahead / 2) >= advisedto) {
+    		posix_fadvise(fileno(fp), pos, readahead, POSIX_FADV_WILLNEED);
+    		advisedto = pos + readahead;
+    	}
+#endif
+
+#ifdef POSIX_FADV_DONTNEED
+    	// Drop what we've consumed once we're a window past it
+    	if ((policy == IOPOLICY_DROPBEHIND) && ((pos - droppedto) >= readahead)) {
+    		long dropend = pos & PAGEMASK;
+    		posix_fadvise(fileno(fp), droppedto, dropend - droppedto, POSIX_FADV_DONTNEED);
+    		droppedto = dropend;
+    	}
+#endif
+    }
+
+    size_t file_reader::read(void *dest, size_t nbytes) {
+    	if (fp) {
+    		size_t bytes_read = fread(dest, 1, nbytes, fp);
+    		pos = pos + bytes_read;
+    		advise();
+
+    		return bytes_read;
+    	}
+
+    	if (directfd < 0)
+    		return 0;
+
+    	size_t total = 0;
+    	unsigned char *out = (unsigned char *)dest;
+
+    	while (total < nbytes) {
+    		if ((pos < directbufferstart) || (pos >= (directbufferstart + directbufferlen))) {
+    			// Refill from the aligned block containing pos
+    			long alignedpos = pos & PAGEMASK;
+    			ssize_t n = pread(directfd, directbuffer, DIRECTIOBLOCKSIZE, alignedpos);
+
+    			if (n <= 0) {
+    				directbufferlen = 0;
+    				break;
+    			}
+
+    			directbufferstart = alignedpos;
+    			directbufferlen = n;
+
+    			if (pos >= (directbufferstart + directbufferlen))
+    				break;  // end of file
+    		}
+
+    		long offset = pos - directbufferstart;
+    		size_t n = directbufferlen - offset;
+
+    		if (n > (nbytes - total))
+    			n = nbytes - total;
+
+    		memcpy(&out[total], &directbuffer[offset], n);
+    		total = total + n;
+    		pos = pos + n;
+    	}
+
+    	return total;
+    }
+
+    file_writer::file_writer(std::string filename, int ipolicy, long iwindow) {
+    	policy = ipolicy;
+    	window = (iwindow > 0) ? iwindow : DEFAULTREADAHEAD;
+    	written = 0;
+    	synced = 0;
+    	dropped = 0;
+
+    	fp = fopen(filename.c_str(), "wb");
+    }
+
+    file_writer::~file_writer() {
+    	close();
+    }
+
+    size_t file_writer::write(const void *src, size_t size, size_t count) {
+    	if (!fp)
+    		return 0;
+
+    	size_t n = fwrite(src, size, count, fp);
+    	written = written + (long)(n * size);
+
+    	if ((policy >= IOPOLICY_DROPBEHIND) && ((written - synced) >= window)) {
+    		fflush(fp);
+    		int fd = fileno(fp);
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    		// Start writeback on the new window without waiting for it...
+    		sync_file_range(fd, synced, written - synced, SYNC_FILE_RANGE_WRITE);
+
+    		// ...and make sure the previous one is on disk so its pages can actually be dropped.
+    		if (synced > dropped) {
+    			sync_file_range(fd, dropped, synced - dropped,
+    					SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    		}
+#else
+    		if (synced > dropped)
+    			fdatasync(fd);
+#endif
+
+#ifdef POSIX_FADV_DONTNEED
+    		if (synced > dropped) {
+    			posix_fadvise(fd, dropped, synced - dropped, POSIX_FADV_DONTNEED);
+    		}
+#endif
+    		dropped = synced;
+    		synced = written;
+    	}
+
+    	return n;
+    }
+
+    void file_writer::close() {
+    	if (!fp)
+    		return;
+
+    	if (policy >= IOPOLICY_DROPBEHIND) {
+    		fflush(fp);
+    		fdatasync(fileno(fp));
+
+#ifdef POSIX_FADV_DONTNEED
+    		posix_fadvise(fileno(fp), 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    	}
+
+    	fclose(fp);
+    	fp = NULL;
+    }
+
+    spsc_ring::spsc_ring(size_t icapacity) : head(0), tail(0) {
+    	capacity = icapacity;
+    	data = new unsigned char[capacity];
+    }
+
+    spsc_ring::~spsc_ring() {
+    	delete[] data;
+    }
+
+    bool spsc_ring::write(const void *src, size_t n) {
+    	if (n > writable())
+    		return false;
+
+    	size_t h = head.load(std::memory_order_relaxed);
+    	size_t offset = h % capacity;
+    	size_t first = capacity - offset;
+
+    	if (first > n)
+    		first = n;
+
+    	memcpy(&data[offset], src, first);
+
+    	if (first < n)
+    		memcpy(data, (const unsigned char *)src + first, n - first);
+
+    	head.store(h + n, std::memory_order_release);
+
+    	return true;
+    }
+
+    size_t spsc_ring::read(void *dest, size_t nmax) {
+    	size_t n = readable();
+
+    	if (n > nmax)
+    		n = nmax;
+
+    	if (n == 0)
+    		return 0;
+
+    	size_t t = tail.load(std::memory_order_relaxed);
+    	size_t offset = t % capacity;
+    	size_t first = capacity - offset;
+
+    	if (first > n)
+    		first = n;
+
+    	memcpy(dest, &data[offset], first);
+
+    	if (first < n)
+    		memcpy((unsigned char *)dest + first, data, n - first);
+
+    	tail.store(t + n, std::memory_order_release);
+
+    	return n;
+    }
+
+    record_file::record_file(std::string filename, int ipolicy, long iprealloc) {
+    	policy = ipolicy;
+    	prealloc = iprealloc;
+    	allocated = 0;
+    	written = 0;
+    	ondisk = 0;
+    	staging = NULL;
+    	staged = 0;
+    	synced = 0;
+    	dropped = 0;
+    	fd = -1;
+
+#ifdef O_DIRECT
+    	if (policy == IOPOLICY_DIRECT) {
+    		fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+
+    		if (fd >= 0) {
+    			if (posix_memalign((void **)&staging, DIRECTIOALIGNMENT, DIRECTIOBLOCKSIZE) != 0) {
+    				::close(fd);
+    				fd = -1;
+    				staging = NULL;
+    			}
+    		}
+
+    		if (fd < 0) {
+    			std::cout << "WARNING: O_DIRECT isn't available for " << filename << ".  Using drop-behind instead." << std::endl;
+    			policy = IOPOLICY_DROPBEHIND;
+    		}
+    	}
+#else
+    	if (policy == IOPOLICY_DIRECT) {
+    		std::cout << "WARNING: O_DIRECT isn't available on this platform.  Using drop-behind instead." << std::endl;
+    		policy = IOPOLICY_DROPBEHIND;
+    	}
+#endif
+
+    	if (fd < 0)
+    		fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+
+    record_file::~record_file() {
+    	close();
+    }
+
+    bool record_file::writeall(const void *src, size_t n, long offset) {
+    	const unsigned char *p = (const unsigned char *)src;
+
+    	while (n > 0) {
+    		ssize_t w = pwrite(fd, p, n, offset);
+
+    		if (w < 0) {
+    			if (errno == EINTR)
+    				continue;
+
+    			return false;
+    		}
+
+    		p = p + w;
+    		n = n - w;
+    		offset = offset + w;
+    	}
+
+    	return true;
+    }
+
+    void record_file::preallocate(long upto) {
+    	// Stay a full increment ahead of the writes.  Filesystems without fallocate just
+    	// allocate as they go.
+    	if ((prealloc <= 0) || (upto <= allocated))
+    		return;
+
+#ifdef FALLOC_FL_KEEP_SIZE
+    	long newallocated = allocated + prealloc;
+
+    	while (newallocated < upto)
+    		newallocated = newallocated + prealloc;
+
+    	// KEEP_SIZE reserves the blocks without moving EOF, so a crash mid-recording still
+    	// leaves a file that's exactly what was written.
+    	if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, newallocated - allocated) == 0) {
+    		allocated = newallocated;
+    	}
+    	else {
+    		prealloc = 0;
+    	}
+#else
+    	prealloc = 0;
+#endif
+    }
+
+    void record_file::dropbehind() {
+    	// Same windowing as file_writer: start writeback on the new window, wait on the
+    	// previous one and drop it from the cache.
+    	if ((policy != IOPOLICY_DROPBEHIND) || ((ondisk - synced) < DEFAULTREADAHEAD))
+    		return;
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    	sync_file_range(fd, synced, ondisk - synced, SYNC_FILE_RANGE_WRITE);
+
+    	if (synced > dropped) {
+    		sync_file_range(fd, dropped, synced - dropped,
+    				SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    	}
+#else
+    	if (synced > dropped)
+    		fdatasync(fd);
+#endif
+
+#ifdef POSIX_FADV_DONTNEED
+    	if (synced > dropped) {
+    		posix_fadvise(fd, dropped, synced - dropped, POSIX_FADV_DONTNEED);
+    	}
+#endif
+    	dropped = synced;
+    	synced = ondisk;
+    }
+
+    bool record_file::write(const void *src, size_t n) {
+    	if (fd < 0)
+    		return false;
+
+    	preallocate(written + n);
+    	written = written + n;
+
+    	if (!staging) {
+    		if (!writeall(src, n, ondisk))
+    			return false;
+
+    		ondisk = ondisk + n;
+    		dropbehind();
+
+    		return true;
+    	}
+
+    	// O_DIRECT: fill the aligned staging buffer and write it out whole
+    	const unsigned char *p = (const unsigned char *)src;
+
+    	while (n > 0) {
+    		size_t chunk = DIRECTIOBLOCKSIZE - staged;
+
+    		if (chunk > n)
+    			chunk = n;
+
+    		memcpy(&staging[staged], p, chunk);
+    		staged = staged + chunk;
+    		p = p + chunk;
+    		n = n - chunk;
+
+    		if (staged == DIRECTIOBLOCKSIZE) {
+    			if (!writeall(staging, staged, ondisk))
+    				return false;
+
+    			ondisk = ondisk + staged;
+    			staged = 0;
+    		}
+    	}
+
+    	return true;
+    }
+
+    void record_file::close() {
+    	if (fd < 0)
+    		return;
+
+    	if (staging) {
+    		if (staged > 0) {
+    			// Last partial block: pad to the alignment, the truncate below takes the padding off
+    			size_t padded = ((staged + DIRECTIOALIGNMENT - 1) / DIRECTIOALIGNMENT) * DIRECTIOALIGNMENT;
+    			memset(&staging[staged], 0, padded - staged);
+    			writeall(staging, padded, ondisk);
+    			ondisk = ondisk + padded;
+    			staged = 0;
+    		}
+
+    		free(staging);
+    		staging = NULL;
+    	}
+
+    	// Trim the padding and release any preallocation past the end
+    	if ((allocated > 0) || (ondisk > written)) {
+    		if (ftruncate(fd, written) != 0)
+    			std::cout << "WARNING: Unable to trim recording to " << written << " bytes." << std::endl;
+    	}
+
+    	if (policy >= IOPOLICY_DROPBEHIND) {
+    		fdatasync(fd);
+
+#ifdef POSIX_FADV_DONTNEED
+    		posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    	}
+
+    	::close(fd);
+    	fd = -1;
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
@@ -0,0 +1,167 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_SQL_FILE_IO_H
+#define INCLUDED_SQL_FILE_IO_H
+
+#include <string>
+#include <cstdio>
+#include <atomic>
+
+// How we treat the page cache while streaming (IOPOLICY)
+#define IOPOLICY_NORMAL 0
+// Tell the kernel we're sequential and keep a readahead window in front of us
+#define IOPOLICY_SEQUENTIAL 1
+// Sequential plus drop what we've already consumed (and written) from the cache
+#define IOPOLICY_DROPBEHIND 2
+// O_DIRECT aligned reads, bypassing the page cache entirely
+#define IOPOLICY_DIRECT 3
+
+#define DEFAULTREADAHEAD (16L * 1024L * 1024L)
+#define DIRECTIOALIGNMENT 4096
+#define DIRECTIOBLOCKSIZE (4L * 1024L * 1024L)
+// record_file grows its preallocation this much at a time
+#define DEFAULTPREALLOCATE (256L * 1024L * 1024L)
+
+namespace gr {
+  namespace sql {
+
+    class file_reader
+    {
+    protected:
+    	std::string filename;
+    	int policy;
+    	long readahead;
+
+    	FILE *fp;       // buffered reads
+    	int directfd;   // IOPOLICY_DIRECT
+
+    	// O_DIRECT bounce buffer.  Reads have to be aligned so we read aligned
+    	// blocks into here and copy out what was asked for.
+    	unsigned char *directbuffer;
+    	long directbufferstart;
+    	long directbufferlen;
+
+    	long pos;
+    	long advisedto;  // readahead hinted up to here
+    	long droppedto;  // cache dropped up to here
+
+    	void advise();
+
+    public:
+    	file_reader(std::string ifilename, int ipolicy=IOPOLICY_NORMAL, long ireadahead=0);
+    	~file_reader();
+
+    	bool is_open() { return (fp != NULL) || (directfd >= 0); }
+    	int fd();
+
+    	bool seek(long newpos);
+    	long position() { return pos; }
+    	size_t read(void *dest, size_t nbytes);
+    };
+
+    class file_writer
+    {
+    protected:
+    	FILE *fp;
+    	int policy;
+    	long window;
+
+    	long written;
+    	long synced;   // writeback started up to here
+    	long dropped;  // written back and dropped from cache up to here
+
+    public:
+    	file_writer(std::string filename, int ipolicy=IOPOLICY_NORMAL, long iwindow=0);
+    	~file_writer();
+
+    	bool is_open() { return fp != NULL; }
+
+    	size_t write(const void *src, size_t size, size_t count);
+    	void close();
+    };
+
+    /*
+     * Single producer / single consumer byte ring.  Neither side takes a lock: head is only
+     * advanced by the producer and tail only by the consumer.
+     */
+    class spsc_ring
+    {
+    protected:
+    	unsigned char *data;
+    	size_t capacity;
+    	std::atomic<size_t> head;  // total bytes written
+    	std::atomic<size_t> tail;  // total bytes read
+
+    public:
+    	spsc_ring(size_t icapacity);
+    	~spsc_ring();
+
+    	size_t size() { return capacity; }
+    	size_t readable() { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed); }
+    	size_t writable() { return capacity - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire)); }
+
+    	// All or nothing.  Returns false (and writes nothing) if there isn't room.
+    	bool write(const void *src, size_t n);
+    	size_t read(void *dest, size_t nmax);
+    };
+
+    /*
+     * Output file for sustained high rate recording.  Space is preallocated ahead of the
+     * writes (fallocate) so the filesystem isn't allocating blocks in the write path, writes
+     * can bypass the page cache (IOPOLICY_DIRECT, through an aligned staging buffer) or drop
+     * behind (IOPOLICY_DROPBEHIND), and close() trims the file back to what was written.
+     */
+    class record_file
+    {
+    protected:
+    	int fd;
+    	int policy;
+    	long prealloc;   // 0 = don't preallocate
+    	long allocated;
+    	long written;    // bytes accepted
+    	long ondisk;     // bytes actually written to fd
+
+    	// O_DIRECT staging.  Writes have to be aligned in address, size and offset.
+    	unsigned char *staging;
+    	size_t staged;
+
+    	long synced;
+    	long dropped;
+
+    	bool writeall(const void *src, size_t n, long offset);
+    	void preallocate(long upto);
+    	void dropbehind();
+
+    public:
+    	record_file(std::string filename, int ipolicy=IOPOLICY_NORMAL, long iprealloc=DEFAULTPREALLOCATE);
+    	~record_file();
+
+    	bool is_open() { return fd >= 0; }
+    	long size() { return written; }
+
+    	bool write(const void *src, size_t n);
+    	void close();
+    };
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_FILE_IO_H */
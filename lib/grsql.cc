@@ -7,16 +7,20 @@
 
 #include <iostream>
 #include <string.h>
+#include <thread>
 
 #include "sqlsource_impl.h"
+#include "grsql_server.h"
 using namespace gr::sql;
 
 void displayHelp() {
 	std::cout << std::endl;
 	std::cout << "Usage: <grsql string>" << std::endl;
+	std::cout << "       --serve <socket path> [--workers <n>]   keep a warm grsql running and take queries on a Unix socket" << std::endl;
+	std::cout << "       --connect <socket path> <grsql string>  run the query on that server (output and exit status as if run here)" << std::endl;
 	std::cout << "grsql string syntax:" << std::endl;
-	std::cout << "SELECT [* | I | Q | TIMELENGTH] FROM '<source file>' ASDATATYPE [COMPLEX | REAL | FLOAT | INT | BYTE | HACKRF (alias for SIGNED8) | RTLSDR (alias for UNSIGNED8) | SIGNED8 | UNSIGNED8] SAMPLERATE <sps [ex: 10000000]> " <<
-			     "[STARTATSAMPLE <sample #> ENDATSAMPLE <sample #>] | [STARTATTIMEOFFSET <hh:mm:ss.ms> | <time as float_sec> ENDATTIMEOFFSET <hh:mm:ss.ms> | <time as float_sec>] [SAVEAS <filename> saveas is not required for TIMELENGTH]" << std::endl;
+	std::cout << "SELECT [* | I | Q | TIMELENGTH | CONSTELLATION [BINS <n>] [RANGE AUTO | <x>] | HEALTH [MINDROPOUT <samples>] [MERGEGAP <samples>]] FROM '<source file>' ASDATATYPE [COMPLEX | REAL | FLOAT | INT | BYTE | HACKRF (alias for SIGNED8) | RTLSDR (alias for UNSIGNED8) | SIGNED8 | UNSIGNED8 | SC16 | SC12 | SC8] SAMPLERATE <sps [ex: 10000000]> " <<
+			     "[STARTATSAMPLE <sample #> ENDATSAMPLE <sample #>] | [STARTATTIMEOFFSET <hh:mm:ss.ms> | <time as float_sec> ENDATTIMEOFFSET <hh:mm:ss.ms> | <time as float_sec>] [RESAMPLE TO <sps> | DECIMATE <n> [TAPS AUTO | <n>]] [CENTER <Hz offset> | CHANNELS AT (<Hz offset>, ...) BANDWIDTH <Hz>] [VLEN <n>] [IOPOLICY NORMAL | SEQUENTIAL | DROPBEHIND | DIRECT] [READAHEAD <bytes, ex: 64M>] [REALTIME [SPEEDUP <x>] [CHUNK <samples>] flowgraph block only] [FOLLOW [LATENCY <ms>] [IDLE <sec, default 10>]] [SHARD INTO <n> [OVERLAP <samples>]] [JOIN '<second file>' [ASDATATYPE <type>] [SAMPLERATE <sps>] ON TIME OFFSET <[-]seconds>] [WHERE MATCHES '<template file>' THRESHOLD <0-1> [WINDOW <before>,<after>] | WHERE ANNOTATION LABEL = '<label>' [PAD <n>[S|MS|US]] [SPLIT]] [SAVEAS <filename> [INTERLEAVED] saveas is not required for TIMELENGTH, HEALTH, MATCHES or ANNOTATION]" << std::endl;
 	std::cout << std::endl;
 	std::cout << "Examples: " << std::endl;
 	std::cout << "Get total time length of a file given its type and sample rate:" << std::endl;
@@ -34,6 +38,50 @@ void displayHelp() {
 	std::cout << "Convert entire rtl_sdr (unsigned 8-bit format) to gnuradio float IQ stream:" << std::endl;
 	std::cout << "grsql \"SELECT * FROM '/tmp/myrecording.raw' ASDATATYPE RTLSDR SAMPLERATE 2.048M STARTTIME 0.0 SAVEAS '/tmp/extracted.raw'\"" << std::endl;
 	std::cout << std::endl;
+	std::cout << "Convert a UHD/BladeRF interleaved int16 (SC16) recording to gnuradio float IQ stream:" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/tmp/usrp_recording.sc16' ASDATATYPE SC16 SAMPLERATE 20M STARTTIME 0.0 SAVEAS '/tmp/extracted.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Extract 10 seconds of a 56 MSPS capture at 2 MSPS (resampled inline with a polyphase filter while reading):" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/tmp/wideband.sc16' ASDATATYPE SC16 SAMPLERATE 56M STARTTIME 10.0 ENDTIME 20.0 RESAMPLE TO 2M SAVEAS '/tmp/narrow.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Pull a 200 kHz channel 3.1 MHz above center out of a 20 MSPS capture (mixed, filtered and decimated in one pass):" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/tmp/wideband.raw' ASDATATYPE complex SAMPLERATE 20M STARTTIME 0.0 CENTER 3.1M BANDWIDTH 200K SAVEAS '/tmp/channel.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Pull several channels in one read (written to /tmp/chan_0.raw, /tmp/chan_1.raw, ...):" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/tmp/wideband.raw' ASDATATYPE complex SAMPLERATE 20M STARTTIME 0.0 CHANNELS AT (-4.5M, -1.2M, 3.1M) BANDWIDTH 200K SAVEAS '/tmp/chan.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Stream a huge recording without flushing everything else out of the page cache:" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/data/capture_500GB.raw' ASDATATYPE complex SAMPLERATE 56M STARTTIME 0.0 IOPOLICY DROPBEHIND READAHEAD 64M SAVEAS '/data/extracted.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Split 10 minutes of a recording into 8 shards (written in parallel) with 4096 samples of lead-in each, plus a manifest of the exact ranges:" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/tmp/myrecording.raw' ASDATATYPE complex SAMPLERATE 6.2M STARTTIME 0 ENDTIME 00:10:00 SHARD INTO 8 OVERLAP 4096 SAVEAS '/tmp/shard.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Line up a second receiver's recording (which started 2.5 ms later) and write the aligned pair to /tmp/pair_0.raw and /tmp/pair_1.raw:" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/data/rx1.raw' ASDATATYPE complex SAMPLERATE 10M STARTTIME 30 ENDTIME 40 JOIN '/data/rx2.sc16' ASDATATYPE SC16 ON TIME OFFSET -0.0025 SAVEAS '/tmp/pair.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Find every burst starting with a known preamble and keep 2000 samples either side (detections go to /tmp/bursts.matches.json):" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/data/capture.sc16' ASDATATYPE SC16 SAMPLERATE 2M STARTTIME 0 WHERE MATCHES '/tmp/preamble.raw' THRESHOLD 0.6 WINDOW 2000,2000 SAVEAS '/tmp/bursts.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Write a 512x512 I/Q constellation image (.pgm, any other extension gets raw uint64 counts) of a whole recording in one pass:" << std::endl;
+	std::cout << "grsql \"SELECT CONSTELLATION BINS 512 FROM '/data/capture.sc16' ASDATATYPE SC16 SAMPLERATE 20M STARTTIME 0 SAVEAS '/tmp/constellation.pgm'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Pull every annotation labeled 'burst' (plus 1 ms either side) out of a SigMF recording, one file per annotation (manifest in /tmp/burst.annotations.json):" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/data/capture.sigmf-data' WHERE ANNOTATION LABEL = 'burst' PAD 1MS SAVEAS '/tmp/burst.raw' SPLIT\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Decimate a capture while it's still being recorded, stopping once it hasn't grown for 30 seconds:" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/data/live.sc16' ASDATATYPE SC16 SAMPLERATE 20M STARTTIME 0 DECIMATE 10 FOLLOW LATENCY 50 IDLE 30 SAVEAS '/tmp/live_2M.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Check a recording for clipping, dropouts and NaN/inf (JSON report, exit code 2 if anything was found):" << std::endl;
+	std::cout << "grsql \"SELECT HEALTH FROM '/data/capture.sc16' ASDATATYPE SC16 SAMPLERATE 20M STARTTIME 0\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Read the data type and sample rate from a .sigmf-meta sidecar next to the file (ex: one recorded with the sqlsink block) by leaving out ASDATATYPE and SAMPLERATE:" << std::endl;
+	std::cout << "grsql \"SELECT * FROM '/data/capture.raw' STARTTIME 10 ENDTIME 20 SAVEAS '/tmp/extracted.raw'\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Serve queries from a warm daemon (ex: for a web front end firing lots of small ones) and run one through it:" << std::endl;
+	std::cout << "grsql --serve /run/grsql.sock --workers 8" << std::endl;
+	std::cout << "grsql --connect /run/grsql.sock \"SELECT TIMELENGTH FROM '/data/capture.sc16' ASDATATYPE SC16 SAMPLERATE 20M\"" << std::endl;
+	std::cout << std::endl;
+	std::cout << "Note: recording (INSERT INTO) is done with the sqlsink flowgraph block." << std::endl;
 	std::cout << "Note: for hackrf/rtlsdr in the gnuradio flowgraph block you can go straight from the signed/unsigned file to output complex to save the conversion step.  ";
 	std::cout << "Also, because on hackrf/rtlsdr processing each sample needs to be processed, expect this to take some time to run through."<< std::endl;
 	std::cout << std::endl;
@@ -49,13 +97,39 @@ main (int argc, char **argv)
 			exit(0);
 		}
 
+		if (strcmp(argv[1],"--serve")==0) {
+			// hardware_concurrency() is 0 when it can't tell.  An explicit --workers still has to be >= 1.
+			int workers = (int)std::thread::hardware_concurrency();
+
+			if (workers < 1)
+				workers = 1;
+
+			if ((argc > 4) && (strcmp(argv[3],"--workers")==0))
+				workers = atoi(argv[4]);
+
+			if ((argc < 3) || (workers < 1)) {
+				displayHelp();
+				exit(1);
+			}
+
+			return serve(argv[2], workers);
+		}
+
+		if (strcmp(argv[1],"--connect")==0) {
+			if (argc < 4) {
+				displayHelp();
+				exit(1);
+			}
+
+			return connect_and_run(argv[2], argv[3]);
+		}
+
 		std::string sqlstring = argv[1];
 		std::cout << "Running with SQL string:" << std::endl << sqlstring << std::endl;
 
 		sqlsource_impl sqlsrc(sqlstring.c_str());
 
-		sqlsrc.runsql();
-
+		return sqlsrc.runsql();
 	}
 	else {
 		displayHelp();
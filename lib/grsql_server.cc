@@ -0,0 +1,636 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // accept4, pipe2
+#endif
+
+#include "grsql_server.h"
+#include "sqlsource_impl.h"
+#include "convert_kernels.h"
+#include "dsp_kernels.h"
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <deque>
+#include <vector>
+
+namespace gr {
+  namespace sql {
+
+    struct serve_request
+    {
+    	std::string cwd;
+    	std::string query;
+    	int outfd;   // client's stdout / stderr, -1 if none were passed
+    	int errfd;
+    };
+
+    struct running_query
+    {
+    	int conn;    // -1 once the worker owns the output (no status to send)
+    	std::chrono::steady_clock::time_point start;
+    };
+
+    // SIGCHLD / SIGINT / SIGTERM just wake up the poll() in serve()
+    static int signalpipe[2] = { -1, -1 };
+    static volatile sig_atomic_t stopping = 0;
+
+    static void on_signal(int signum) {
+    	int savederrno = errno;
+
+    	if (signum != SIGCHLD)
+    		stopping = 1;
+
+    	char c = 0;
+
+    	if (write(signalpipe[1], &c, 1) < 0) {
+    		// pipe full: poll() will wake up anyway
+    	}
+
+    	errno = savederrno;
+    }
+
+    static bool read_fully(int fd, void *buf, size_t len) {
+    	unsigned char *p = (unsigned char *)buf;
+
+    	while (len > 0) {
+    		ssize_t n = read(fd, p, len);
+
+    		if (n < 0 && errno == EINTR)
+    			continue;
+
+    		if (n <= 0)
+    			return false;
+
+    		p += n;
+    		len -= n;
+    	}
+
+    	return true;
+    }
+
+    static bool write_fully(int fd, const void *buf, size_t len) {
+    	const unsigned char *p = (const unsigned char *)buf;
+
+    	while (len > 0) {
+    		ssize_t n = write(fd, p, len);
+
+    		if (n < 0 && errno == EINTR)
+    			continue;
+
+    		if (n <= 0)
+    			return false;
+
+    		p += n;
+    		len -= n;
+    	}
+
+    	return true;
+    }
+
+    static void make_address(const std::string &socketpath, struct sockaddr_un &addr) {
+    	if (socketpath.length() >= sizeof(addr.sun_path)) {
+    		std::cout << "ERROR: The socket path " << socketpath << " is too long (" << sizeof(addr.sun_path) - 1 << " characters max)." << std::endl;
+    		exit(1);
+    	}
+
+    	memset(&addr, 0, sizeof(addr));
+    	addr.sun_family = AF_UNIX;
+    	strncpy(addr.sun_path, socketpath.c_str(), sizeof(addr.sun_path) - 1);
+    }
+
+    // A connection that hasn't sent all of its request yet.  Requests are read a piece at a
+    // time as they arrive so a slow (or silent) client can't hold up anyone else.
+    struct pending_request
+    {
+    	serve_request req;
+    	std::vector<unsigned char> data;   // uint32 cwd length, uint32 query length, cwd, query
+    	std::chrono::steady_clock::time_point deadline;
+    };
+
+    static void close_request_fds(serve_request &req) {
+    	if (req.outfd >= 0) {
+    		close(req.outfd);
+    		close(req.errfd);
+    		req.outfd = -1;
+    		req.errfd = -1;
+    	}
+    }
+
+    // 1 = complete, 0 = waiting on more, -1 = bad request or the client went away
+    static int read_request_part(int conn, pending_request &p) {
+    	size_t need = 2 * sizeof(uint32_t);
+
+    	while (true) {
+    		if (p.data.size() >= 2 * sizeof(uint32_t)) {
+    			uint32_t lengths[2];
+    			memcpy(lengths, &p.data[0], sizeof(lengths));
+
+    			if ((lengths[0] > SERVEMAXQUERY) || (lengths[1] == 0) || (lengths[1] > SERVEMAXQUERY))
+    				return -1;
+
+    			need = sizeof(lengths) + lengths[0] + lengths[1];
+
+    			if (p.data.size() == need) {
+    				p.req.cwd.assign((const char *)&p.data[sizeof(lengths)], lengths[0]);
+    				p.req.query.assign((const char *)&p.data[sizeof(lengths) + lengths[0]], lengths[1]);
+    				return 1;
+    			}
+    		}
+
+    		size_t have = p.data.size();
+    		p.data.resize(need);
+
+    		union {
+    			char buf[CMSG_SPACE(2 * sizeof(int))];
+    			struct cmsghdr align;
+    		} control;
+
+    		struct iovec iov;
+    		iov.iov_base = &p.data[have];
+    		iov.iov_len = need - have;
+
+    		struct msghdr msg;
+    		memset(&msg, 0, sizeof(msg));
+    		msg.msg_iov = &iov;
+    		msg.msg_iovlen = 1;
+    		msg.msg_control = control.buf;
+    		msg.msg_controllen = sizeof(control.buf);
+
+    		ssize_t n = recvmsg(conn, &msg, MSG_DONTWAIT | MSG_CMSG_CLOEXEC);
+
+    		if (n < 0) {
+    			p.data.resize(have);
+
+    			if (errno == EINTR)
+    				continue;
+
+    			if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+    				return 0;
+
+    			return -1;
+    		}
+
+    		p.data.resize(have + n);
+
+    		// The descriptors (if any) come with the first bytes
+    		for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    			if ((cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS))
+    				continue;
+
+    			int nfds = (int)((cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+    			int fds[2];
+
+    			memcpy(fds, CMSG_DATA(cmsg), nfds * sizeof(int));
+
+    			if ((nfds == 2) && (p.req.outfd < 0)) {
+    				p.req.outfd = fds[0];
+    				p.req.errfd = fds[1];
+    			}
+    			else {
+    				for (int f=0;f<nfds;f++)
+    					close(fds[f]);
+    			}
+    		}
+
+    		if ((n == 0) || (msg.msg_flags & MSG_CTRUNC))
+    			return -1;
+    	}
+    }
+
+    static void run_worker(serve_request &req, int conn, int listenfd, const std::vector<int> &otherfds) {
+    	// Forked from the daemon: VOLK is primed and the query's sidecars are parsed, just swap
+    	// in the client's output and run the query the same way grsql would.
+    	close(listenfd);
+    	close(signalpipe[0]);
+    	close(signalpipe[1]);
+
+    	// Other clients' connections and descriptors.  Holding them would keep their sockets
+    	// open (no EOF) for as long as this query runs.
+    	for (size_t f=0;f<otherfds.size();f++)
+    		close(otherfds[f]);
+
+    	signal(SIGCHLD, SIG_DFL);
+    	signal(SIGINT, SIG_DFL);
+    	signal(SIGTERM, SIG_DFL);
+    	signal(SIGPIPE, SIG_DFL);
+
+    	// The daemon reads requests non-blocking, output is written normally
+    	fcntl(conn, F_SETFL, fcntl(conn, F_GETFL) & ~O_NONBLOCK);
+
+    	int outfd = (req.outfd >= 0) ? req.outfd : conn;
+    	int errfd = (req.errfd >= 0) ? req.errfd : conn;
+
+    	dup2(outfd, STDOUT_FILENO);
+    	dup2(errfd, STDERR_FILENO);
+
+    	close_request_fds(req);
+    	close(conn);
+
+    	if ((req.cwd.length() > 0) && (chdir(req.cwd.c_str()) != 0)) {
+    		std::cout << "ERROR: Unable to change to the client's directory " << req.cwd << std::endl;
+    		exit(1);
+    	}
+
+    	int rc;
+
+    	{
+    		sqlsource_impl sqlsrc(req.query.c_str());
+    		rc = sqlsrc.runsql();
+    	}
+
+    	std::cout.flush();
+    	exit(rc);
+    }
+
+    static void prime_daemon() {
+    	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    	prime_convert_kernels();
+    	prime_dsp_kernels();
+    	sqlsource_impl::CacheSidecars(true);
+
+    	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    	std::cout << "INFO: Kernels primed in " << ms << " ms" << std::endl;
+    }
+
+    int serve(const std::string &socketpath, int maxworkers) {
+    	struct sockaddr_un addr;
+    	make_address(socketpath, addr);
+
+    	struct stat st;
+
+    	if ((stat(socketpath.c_str(), &st) == 0) && S_ISSOCK(st.st_mode)) {
+    		// Left behind by a daemon that didn't shut down cleanly, unless one is still listening
+    		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    		if ((probe >= 0) && (connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0)) {
+    			std::cout << "ERROR: A grsql server is already running on " << socketpath << std::endl;
+    			exit(1);
+    		}
+
+    		if (probe >= 0)
+    			close(probe);
+
+    		unlink(socketpath.c_str());
+    	}
+
+    	int listenfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    	if ((listenfd < 0) || (bind(listenfd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(listenfd, SERVELISTENBACKLOG) != 0)) {
+    		std::cout << "ERROR: Unable to listen on " << socketpath << ": " << strerror(errno) << std::endl;
+    		exit(1);
+    	}
+
+    	if (pipe2(signalpipe, O_CLOEXEC | O_NONBLOCK) != 0) {
+    		std::cout << "ERROR: Unable to create the signal pipe: " << strerror(errno) << std::endl;
+    		exit(1);
+    	}
+
+    	struct sigaction sa;
+    	memset(&sa, 0, sizeof(sa));
+    	sa.sa_handler = on_signal;
+    	sigemptyset(&sa.sa_mask);
+    	sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+    	sigaction(SIGCHLD, &sa, NULL);
+    	sigaction(SIGINT, &sa, NULL);
+    	sigaction(SIGTERM, &sa, NULL);
+    	// A client going away mid-reply shouldn't take the daemon with it
+    	signal(SIGPIPE, SIG_IGN);
+
+    	prime_daemon();
+
+    	std::cout << "INFO: grsql serving on " << socketpath << " with up to " << maxworkers << " queries at a time" << std::endl;
+
+    	std::map<pid_t, running_query> running;
+    	std::map<int, pending_request> pending;                 // by connection, still arriving
+    	std::deque< std::pair<int, serve_request> > ready;      // complete, waiting on a free worker
+
+    	while (true) {
+    		int status;
+    		pid_t pid;
+
+    		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+    			std::map<pid_t, running_query>::iterator it = running.find(pid);
+
+    			if (it == running.end())
+    				continue;
+
+    			int32_t rc = WIFEXITED(status) ? WEXITSTATUS(status) : (WIFSIGNALED(status) ? 128 + WTERMSIG(status) : 1);
+
+    			if (it->second.conn >= 0) {
+    				write_fully(it->second.conn, &rc, sizeof(rc));
+    				close(it->second.conn);
+    			}
+
+    			double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - it->second.start).count();
+    			std::cout << "INFO: [" << pid << "] finished with status " << rc << " in " << ms << " ms" << std::endl;
+
+    			running.erase(it);
+    		}
+
+    		if (stopping) {
+    			// Let running queries finish, drop the ones that haven't started
+    			for (std::map<int, pending_request>::iterator it = pending.begin(); it != pending.end(); ++it) {
+    				close_request_fds(it->second.req);
+    				close(it->first);
+    			}
+
+    			for (size_t r=0;r<ready.size();r++) {
+    				close_request_fds(ready[r].second);
+    				close(ready[r].first);
+    			}
+
+    			pending.clear();
+    			ready.clear();
+
+    			if (running.size() == 0)
+    				break;
+    		}
+
+    		// Start what's waiting, up to --workers at a time
+    		while ((ready.size() > 0) && ((int)running.size() < maxworkers)) {
+    			int conn = ready.front().first;
+    			serve_request req = ready.front().second;
+    			ready.pop_front();
+
+    			std::vector<int> otherfds;
+
+    			for (std::map<pid_t, running_query>::iterator it = running.begin(); it != running.end(); ++it) {
+    				if (it->second.conn >= 0)
+    					otherfds.push_back(it->second.conn);
+    			}
+
+    			for (std::map<int, pending_request>::iterator it = pending.begin(); it != pending.end(); ++it) {
+    				otherfds.push_back(it->first);
+
+    				if (it->second.req.outfd >= 0) {
+    					otherfds.push_back(it->second.req.outfd);
+    					otherfds.push_back(it->second.req.errfd);
+    				}
+    			}
+
+    			for (size_t r=0;r<ready.size();r++) {
+    				otherfds.push_back(ready[r].first);
+
+    				if (ready[r].second.outfd >= 0) {
+    					otherfds.push_back(ready[r].second.outfd);
+    					otherfds.push_back(ready[r].second.errfd);
+    				}
+    			}
+
+    			// Nothing buffered in the daemon should be repeated by the worker
+    			std::cout.flush();
+
+    			running_query query;
+    			query.start = std::chrono::steady_clock::now();
+
+    			pid = fork();
+
+    			if (pid == 0)
+    				run_worker(req, conn, listenfd, otherfds);
+
+    			bool passedfds = (req.outfd >= 0);
+    			close_request_fds(req);
+
+    			if (pid < 0) {
+    				std::cout << "ERROR: Unable to start a worker: " << strerror(errno) << std::endl;
+    				int32_t rc = 1;
+    				write_fully(conn, &rc, sizeof(rc));
+    				close(conn);
+    				continue;
+    			}
+
+    			if (passedfds) {
+    				query.conn = conn;
+    			}
+    			else {
+    				// The worker has the socket as its output, EOF when it exits is the reply
+    				close(conn);
+    				query.conn = -1;
+    			}
+
+    			running[pid] = query;
+
+    			std::cout << "INFO: [" << pid << "] " << req.query << std::endl;
+    		}
+
+    		// Poll the signal pipe, the connections still sending and (if there's room to hold
+    		// more requests) the listening socket.  Anything beyond that waits in the backlog.
+    		std::vector<struct pollfd> fds;
+    		struct pollfd pfd;
+
+    		pfd.fd = signalpipe[0];
+    		pfd.events = POLLIN;
+    		pfd.revents = 0;
+    		fds.push_back(pfd);
+
+    		bool accepting = !stopping && ((pending.size() + ready.size()) < (size_t)SERVEMAXPENDING);
+
+    		if (accepting) {
+    			pfd.fd = listenfd;
+    			fds.push_back(pfd);
+    		}
+
+    		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    		int timeoutms = -1;
+
+    		for (std::map<int, pending_request>::iterator it = pending.begin(); it != pending.end(); ++it) {
+    			pfd.fd = it->first;
+    			fds.push_back(pfd);
+
+    			int left = (int)std::chrono::duration_cast<std::chrono::milliseconds>(it->second.deadline - now).count() + 1;
+
+    			if (left < 0)
+    				left = 0;
+
+    			if ((timeoutms < 0) || (left < timeoutms))
+    				timeoutms = left;
+    		}
+
+    		if (poll(&fds[0], fds.size(), timeoutms) < 0) {
+    			if (errno == EINTR)
+    				continue;
+
+    			std::cout << "ERROR: poll() failed: " << strerror(errno) << std::endl;
+    			exit(1);
+    		}
+
+    		if (fds[0].revents & POLLIN) {
+    			char drain[64];
+
+    			while (read(signalpipe[0], drain, sizeof(drain)) > 0) {
+    			}
+    		}
+
+    		size_t first = 1;
+
+    		if (accepting) {
+    			first = 2;
+
+    			if (fds[1].revents & POLLIN) {
+    				int conn = accept4(listenfd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+
+    				if (conn >= 0) {
+    					pending_request &p = pending[conn];
+    					p.req.outfd = -1;
+    					p.req.errfd = -1;
+    					p.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SERVEREQUESTTIMEOUTMS);
+    				}
+    			}
+    		}
+
+    		now = std::chrono::steady_clock::now();
+
+    		for (size_t f=first;f<fds.size();f++) {
+    			std::map<int, pending_request>::iterator it = pending.find(fds[f].fd);
+
+    			if (it == pending.end())
+    				continue;
+
+    			int conn = it->first;
+    			int result = 0;
+
+    			if (fds[f].revents)
+    				result = read_request_part(conn, it->second);
+
+    			if ((result == 0) && (now >= it->second.deadline)) {
+    				std::cout << "WARNING: Dropped a connection that didn't send its request within " << SERVEREQUESTTIMEOUTMS << " ms." << std::endl;
+    				result = -1;
+    			}
+    			else if (result < 0) {
+    				std::cout << "WARNING: Dropped a connection with an incomplete or oversized request." << std::endl;
+    			}
+
+    			if (result < 0) {
+    				close_request_fds(it->second.req);
+    				close(conn);
+    				pending.erase(it);
+    			}
+    			else if (result > 0) {
+    				// Parse (or revalidate) the sidecars here so every worker forked from now on has them
+    				sqlsource_impl::PrimeSidecars(it->second.req.query, it->second.req.cwd);
+
+    				ready.push_back(std::make_pair(conn, it->second.req));
+    				pending.erase(it);
+    			}
+    		}
+    	}
+
+    	close(listenfd);
+    	unlink(socketpath.c_str());
+
+    	std::cout << "INFO: grsql server on " << socketpath << " stopped." << std::endl;
+
+    	return 0;
+    }
+
+    int connect_and_run(const std::string &socketpath, const std::string &sqlstring) {
+    	struct sockaddr_un addr;
+    	make_address(socketpath, addr);
+
+    	if (sqlstring.length() > SERVEMAXQUERY) {
+    		std::cout << "ERROR: The query is longer than " << SERVEMAXQUERY << " characters." << std::endl;
+    		exit(1);
+    	}
+
+    	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+    	if ((fd < 0) || (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)) {
+    		std::cout << "ERROR: Unable to connect to a grsql server on " << socketpath << ": " << strerror(errno) << std::endl;
+    		exit(1);
+    	}
+
+    	char cwdbuf[PATH_MAX];
+    	std::string cwd;
+
+    	if (getcwd(cwdbuf, sizeof(cwdbuf)) != NULL)
+    		cwd = cwdbuf;
+
+    	uint32_t lengths[2];
+    	lengths[0] = (uint32_t)cwd.length();
+    	lengths[1] = (uint32_t)sqlstring.length();
+
+    	// Hand over our stdout / stderr so the output lands here as if we'd run the query ourselves
+    	int fds[2] = { STDOUT_FILENO, STDERR_FILENO };
+    	union {
+    		char buf[CMSG_SPACE(sizeof(fds))];
+    		struct cmsghdr align;
+    	} control;
+
+    	struct iovec iov;
+    	iov.iov_base = lengths;
+    	iov.iov_len = sizeof(lengths);
+
+    	struct msghdr msg;
+    	memset(&msg, 0, sizeof(msg));
+    	msg.msg_iov = &iov;
+    	msg.msg_iovlen = 1;
+    	msg.msg_control = control.buf;
+    	msg.msg_controllen = sizeof(control.buf);
+
+    	struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    	cmsg->cmsg_level = SOL_SOCKET;
+    	cmsg->cmsg_type = SCM_RIGHTS;
+    	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+    	std::cout.flush();
+
+    	ssize_t n;
+
+    	do {
+    		n = sendmsg(fd, &msg, 0);
+    	} while (n < 0 && errno == EINTR);
+
+    	bool ok = (n >= 0) && write_fully(fd, (const unsigned char *)lengths + n, sizeof(lengths) - n) &&
+    			write_fully(fd, cwd.data(), cwd.length()) && write_fully(fd, sqlstring.data(), sqlstring.length());
+
+    	int32_t rc;
+
+    	if (!ok || !read_fully(fd, &rc, sizeof(rc))) {
+    		std::cout << "ERROR: The grsql server on " << socketpath << " closed the connection without finishing the query." << std::endl;
+    		exit(1);
+    	}
+
+    	close(fd);
+
+    	return rc;
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
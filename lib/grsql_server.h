@@ -0,0 +1,60 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_SQL_GRSQL_SERVER_H
+#define INCLUDED_SQL_GRSQL_SERVER_H
+
+#include <string>
+
+// Longest query (and working directory) a client can send
+#define SERVEMAXQUERY 65536
+// A client has this long to send its query once connected
+#define SERVEREQUESTTIMEOUTMS 2000
+#define SERVELISTENBACKLOG 64
+// Requests being read or waiting on a worker.  More connections wait in the backlog.
+#define SERVEMAXPENDING 64
+
+namespace gr {
+  namespace sql {
+
+    /*
+     * grsql --serve / --connect
+     *
+     * The daemon primes VOLK's kernel dispatch once and keeps parsed SigMF sidecars
+     * (rechecked against the file on every use).  Each query runs in a worker forked from
+     * it (at most maxworkers at a time), so it starts with both, skips process startup,
+     * and an ERROR in one can't take the daemon down.  Requests are read without blocking,
+     * so a slow client only holds up itself.
+     *
+     * Request: uint32 cwd length, uint32 query length, cwd, query.  The client's stdout
+     * and stderr ride along with the first bytes (SCM_RIGHTS) and the worker writes
+     * straight to them, so the output (and SAVEAS '/dev/stdout') is what running grsql
+     * locally would give.  Reply: int32 exit status.  A client that doesn't pass
+     * descriptors gets the output on the socket instead, followed by EOF (no status).
+     */
+    int serve(const std::string &socketpath, int maxworkers);
+
+    // Sends the query to a daemon and returns its exit status
+    int connect_and_run(const std::string &socketpath, const std::string &sqlstring);
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_GRSQL_SERVER_H */
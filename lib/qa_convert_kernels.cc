@@ -0,0 +1,169 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "convert_kernels.h"
+#include "sqlsource_impl.h"
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <cstring>
+#include <random>
+#include <vector>
+
+namespace gr {
+  namespace sql {
+
+    // Odd length so the SIMD kernels run their scalar tails as well
+    #define CONVERT_SAMPLES 1027
+
+    static std::vector<unsigned char> random_bytes(size_t n, unsigned int seed) {
+    	std::mt19937 gen(seed);
+    	std::vector<unsigned char> bytes(n);
+
+    	for (size_t i=0;i<n;i++)
+    		bytes[i] = (unsigned char)(gen() & 0xFF);
+
+    	// Make sure the extremes are in there
+    	if (n >= 4) {
+    		bytes[0] = 0x00;
+    		bytes[1] = 0xFF;
+    		bytes[2] = 0x80;
+    		bytes[3] = 0x7F;
+    	}
+
+    	return bytes;
+    }
+
+    static std::vector<float> convert(int datatype, int selectaction, const std::vector<unsigned char> &in, long nsamples,
+    		int outpersample) {
+    	convert_kernel kernel = get_convert_kernel(datatype, selectaction);
+    	BOOST_REQUIRE(kernel != NULL);
+
+    	std::vector<float> out(nsamples * outpersample);
+    	kernel(&in[0], nsamples, &out[0]);
+
+    	return out;
+    }
+
+    static void check_floats(const std::vector<float> &actual, const std::vector<float> &expected) {
+    	BOOST_REQUIRE_EQUAL(actual.size(), expected.size());
+
+    	for (size_t i=0;i<actual.size();i++) {
+    		if (std::fabs(actual[i] - expected[i]) > 1e-6f)
+    			BOOST_FAIL("value " << i << " is " << actual[i] << ", expected " << expected[i]);
+    	}
+    }
+
+    BOOST_AUTO_TEST_CASE(t_convert_signed8) {
+    	// hackrf_transfer / UHD SC8: (signed char)b / 127
+    	std::vector<unsigned char> in = random_bytes(2 * CONVERT_SAMPLES, 1);
+    	std::vector<float> expected(2 * CONVERT_SAMPLES);
+
+    	for (size_t i=0;i<expected.size();i++)
+    		expected[i] = (float)(signed char)in[i] / 127.0f;
+
+    	check_floats(convert(DATATYPE_SIGNED8, SELECT_STAR, in, CONVERT_SAMPLES, 2), expected);
+    	check_floats(convert(DATATYPE_SC8, SELECT_STAR, in, CONVERT_SAMPLES, 2), expected);
+    }
+
+    BOOST_AUTO_TEST_CASE(t_convert_unsigned8) {
+    	// rtl_sdr: b / 127.5 - 1, every byte value
+    	std::vector<unsigned char> in(2 * 256);
+    	std::vector<float> expected(in.size());
+
+    	for (size_t i=0;i<in.size();i++) {
+    		in[i] = (unsigned char)(i % 256);
+    		expected[i] = (float)in[i] / (255.0f / 2.0f) - 1.0f;
+    	}
+
+    	check_floats(convert(DATATYPE_UNSIGNED8, SELECT_STAR, in, 256, 2), expected);
+    }
+
+    BOOST_AUTO_TEST_CASE(t_convert_sc16) {
+    	// Interleaved int16 / 32767
+    	std::vector<unsigned char> in = random_bytes(4 * CONVERT_SAMPLES, 2);
+    	std::vector<float> expected(2 * CONVERT_SAMPLES);
+
+    	for (size_t i=0;i<expected.size();i++) {
+    		int16_t v;
+    		memcpy(&v, &in[2 * i], sizeof(v));
+    		expected[i] = (float)v / 32767.0f;
+    	}
+
+    	check_floats(convert(DATATYPE_SC16, SELECT_STAR, in, CONVERT_SAMPLES, 2), expected);
+    }
+
+    BOOST_AUTO_TEST_CASE(t_convert_sc12) {
+    	// I = b0 | (b1 & 0x0F) << 8, Q = (b1 >> 4) | b2 << 4, both signed 12-bit / 2047
+    	std::vector<unsigned char> in = random_bytes(3 * CONVERT_SAMPLES, 3);
+    	std::vector<float> expected(2 * CONVERT_SAMPLES);
+
+    	for (size_t j=0;j<CONVERT_SAMPLES;j++) {
+    		int ival = in[3*j] | ((in[3*j+1] & 0x0F) << 8);
+    		int qval = (in[3*j+1] >> 4) | (in[3*j+2] << 4);
+
+    		if (ival >= 2048)
+    			ival -= 4096;
+    		if (qval >= 2048)
+    			qval -= 4096;
+
+    		expected[2*j] = (float)ival / 2047.0f;
+    		expected[2*j+1] = (float)qval / 2047.0f;
+    	}
+
+    	check_floats(convert(DATATYPE_SC12, SELECT_STAR, in, CONVERT_SAMPLES, 2), expected);
+    }
+
+    BOOST_AUTO_TEST_CASE(t_convert_select_iq) {
+    	std::mt19937 gen(4);
+    	std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    	std::vector<gr_complex> samples(CONVERT_SAMPLES);
+
+    	for (size_t i=0;i<samples.size();i++)
+    		samples[i] = gr_complex(dist(gen), dist(gen));
+
+    	std::vector<unsigned char> in(samples.size() * sizeof(gr_complex));
+    	memcpy(&in[0], &samples[0], in.size());
+
+    	std::vector<float> expectedi(samples.size());
+    	std::vector<float> expectedq(samples.size());
+
+    	for (size_t i=0;i<samples.size();i++) {
+    		expectedi[i] = samples[i].real();
+    		expectedq[i] = samples[i].imag();
+    	}
+
+    	check_floats(convert(DATATYPE_COMPLEX, SELECT_I, in, CONVERT_SAMPLES, 1), expectedi);
+    	check_floats(convert(DATATYPE_COMPLEX, SELECT_Q, in, CONVERT_SAMPLES, 1), expectedq);
+    }
+
+    BOOST_AUTO_TEST_CASE(t_convert_passthrough) {
+    	// Types that are output exactly as recorded have no kernel
+    	const int datatypes[] = { DATATYPE_COMPLEX, DATATYPE_FLOAT, DATATYPE_INT, DATATYPE_SHORT, DATATYPE_BYTE };
+
+    	for (size_t i=0;i<sizeof(datatypes)/sizeof(datatypes[0]);i++)
+    		BOOST_CHECK(get_convert_kernel(datatypes[i], SELECT_STAR) == NULL);
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
@@ -0,0 +1,295 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "dsp_kernels.h"
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <random>
+#include <vector>
+
+namespace gr {
+  namespace sql {
+
+    // Push sizes that don't line up with the filter length, the decimation or each other
+    static const long pushsizes[] = { 1, 7, 63, 64, 1000, 3, 4096, 517, 2 };
+    #define NUMPUSHSIZES (sizeof(pushsizes) / sizeof(pushsizes[0]))
+
+    static std::vector<gr_complex> random_samples(long n, unsigned int seed) {
+    	std::mt19937 gen(seed);
+    	std::normal_distribution<float> dist(0.0f, 0.5f);
+    	std::vector<gr_complex> samples(n);
+
+    	for (long i=0;i<n;i++)
+    		samples[i] = gr_complex(dist(gen), dist(gen));
+
+    	return samples;
+    }
+
+    // Everything in one push, then pull it all
+    static std::vector<gr_complex> run_once(stream_filter<gr_complex> &filter, const std::vector<gr_complex> &in) {
+    	filter.push(&in[0], (long)in.size());
+
+    	std::vector<gr_complex> out(filter.available());
+
+    	if (!out.empty())
+    		filter.pull(&out[0], (long)out.size());
+
+    	return out;
+    }
+
+    // Odd sized pushes, pulling part of what's ready in between so the queues get compacted too
+    static std::vector<gr_complex> run_chunked(stream_filter<gr_complex> &filter, const std::vector<gr_complex> &in) {
+    	std::vector<gr_complex> out;
+    	long pos = 0;
+    	long total = (long)in.size();
+
+    	for (size_t c=0;pos < total;c++) {
+    		long n = std::min(pushsizes[c % NUMPUSHSIZES], total - pos);
+    		filter.push(&in[pos], n);
+    		pos = pos + n;
+
+    		long ready = filter.available();
+
+    		if (c % 3 == 1)
+    			ready = ready / 2;
+
+    		if (ready > 0) {
+    			std::vector<gr_complex> buff(ready);
+    			filter.pull(&buff[0], ready);
+    			out.insert(out.end(), buff.begin(), buff.end());
+    		}
+    	}
+
+    	long ready = filter.available();
+
+    	if (ready > 0) {
+    		std::vector<gr_complex> buff(ready);
+    		filter.pull(&buff[0], ready);
+    		out.insert(out.end(), buff.begin(), buff.end());
+    	}
+
+    	return out;
+    }
+
+    static void check_close(const std::vector<gr_complex> &a, const std::vector< std::complex<double> > &b, double tolerance) {
+    	BOOST_REQUIRE_EQUAL(a.size(), b.size());
+
+    	for (size_t i=0;i<a.size();i++) {
+    		double err = std::abs(std::complex<double>(a[i].real(), a[i].imag()) - b[i]);
+
+    		if (err > tolerance)
+    			BOOST_FAIL("sample " << i << " is " << a[i] << ", expected " << b[i]);
+    	}
+    }
+
+    static std::vector< std::complex<double> > widen(const std::vector<gr_complex> &a) {
+    	return std::vector< std::complex<double> >(a.begin(), a.end());
+    }
+
+    /*
+     * Straight from the definition: zero-stuff by interp, filter, keep every decim'th sample.
+     * y[m] = sum_j h[j] * xup[m*decim - j], xup[n] = x[n / interp] when interp divides n.
+     */
+    static std::vector< std::complex<double> > resample_reference(const std::vector<gr_complex> &x, int interp, int decim,
+    		const std::vector<float> &taps) {
+    	std::vector< std::complex<double> > y;
+    	long n = (long)x.size();
+
+    	// Same output count the streaming filter gives: every m whose window starts in the input
+    	for (long m=0;(m * decim) / interp < n;m++) {
+    		std::complex<double> sum(0.0, 0.0);
+
+    		for (long j=0;j<(long)taps.size();j++) {
+    			long up = m * decim - j;
+
+    			if (up < 0 || (up % interp) != 0)
+    				continue;
+
+    			sum += (double)taps[j] * std::complex<double>(x[up / interp].real(), x[up / interp].imag());
+    		}
+
+    		y.push_back(sum);
+    	}
+
+    	return y;
+    }
+
+    // Mix down, filter, decimate: y[m] = sum_k h[k] * x[m*decim - k] * e^(-jw(m*decim - k))
+    static std::vector< std::complex<double> > xlate_reference(const std::vector<gr_complex> &x, int decim,
+    		const std::vector<float> &taps, double centerfreq, double samplerate) {
+    	std::vector< std::complex<double> > y;
+    	long n = (long)x.size();
+    	double w = 2.0 * M_PI * centerfreq / samplerate;
+
+    	for (long m=0;m * decim < n;m++) {
+    		std::complex<double> sum(0.0, 0.0);
+
+    		for (long k=0;k<(long)taps.size();k++) {
+    			long i = m * decim - k;
+
+    			if (i < 0)
+    				break;
+
+    			std::complex<double> mixer(cos(-w * i), sin(-w * i));
+    			sum += (double)taps[k] * std::complex<double>(x[i].real(), x[i].imag()) * mixer;
+    		}
+
+    		y.push_back(sum);
+    	}
+
+    	return y;
+    }
+
+    BOOST_AUTO_TEST_CASE(t_rational_resampler_across_pushes) {
+    	const int ratios[][2] = { { 3, 2 }, { 2, 3 }, { 1, 4 }, { 5, 7 }, { 4, 1 } };
+    	std::vector<gr_complex> in = random_samples(20000, 1);
+
+    	for (size_t r=0;r<sizeof(ratios)/sizeof(ratios[0]);r++) {
+    		int interp = ratios[r][0];
+    		int decim = ratios[r][1];
+    		std::vector<float> taps = rational_resampler<gr_complex>::design_taps(interp, decim);
+
+    		rational_resampler<gr_complex> once(interp, decim, taps);
+    		rational_resampler<gr_complex> chunked(interp, decim, taps);
+
+    		std::vector<gr_complex> onceout = run_once(once, in);
+    		std::vector<gr_complex> chunkedout = run_chunked(chunked, in);
+
+    		BOOST_TEST_MESSAGE("interp " << interp << " decim " << decim << ": " << onceout.size() << " samples");
+
+    		// Push boundaries only change which VOLK path lines up, so float rounding at most
+    		check_close(chunkedout, widen(onceout), 1e-5);
+    		check_close(onceout, resample_reference(in, interp, decim, taps), 1e-4);
+    	}
+    }
+
+    BOOST_AUTO_TEST_CASE(t_freq_xlating_decimator_across_pushes) {
+    	const int decims[] = { 1, 5, 16 };
+    	const double centers[] = { 0.0, 123456.7, -301000.0 };
+    	double samplerate = 1e6;
+    	std::vector<gr_complex> in = random_samples(20000, 2);
+
+    	for (size_t d=0;d<sizeof(decims)/sizeof(decims[0]);d++) {
+    		for (size_t c=0;c<sizeof(centers)/sizeof(centers[0]);c++) {
+    			int decim = decims[d];
+    			std::vector<float> taps = design_lowpass(1.0, samplerate, samplerate / (2.5 * decim),
+    					samplerate / (10.0 * decim));
+
+    			freq_xlating_decimator once(decim, taps, centers[c], samplerate);
+    			freq_xlating_decimator chunked(decim, taps, centers[c], samplerate);
+
+    			std::vector<gr_complex> onceout = run_once(once, in);
+    			std::vector<gr_complex> chunkedout = run_chunked(chunked, in);
+
+    			BOOST_CHECK_EQUAL(onceout.size(), (in.size() + decim - 1) / decim);
+    			check_close(chunkedout, widen(onceout), 1e-5);
+    			// The output mixer is a float phasor stepped per sample, so it drifts a little
+    			check_close(onceout, xlate_reference(in, decim, taps, centers[c], samplerate), 1e-3);
+    		}
+    	}
+    }
+
+    BOOST_AUTO_TEST_CASE(t_fft_filterbank_flush_length) {
+    	// The filterbank only runs at the power of 2 decimations GetChannelDecimation hands it
+    	const int decims[] = { 8, 32 };
+    	double samplerate = 1e6;
+    	std::vector<double> centers;
+    	centers.push_back(-200000.0);
+    	centers.push_back(0.0);
+    	centers.push_back(312345.0);
+
+    	for (size_t d=0;d<sizeof(decims)/sizeof(decims[0]);d++) {
+    		int decim = decims[d];
+    		std::vector<float> taps = design_lowpass(1.0, samplerate, samplerate / (2.5 * decim),
+    				samplerate / (10.0 * decim));
+    		const long lengths[] = { 0, 1, decim - 1, decim, decim + 1, 4095, 4096, 4097, 10000, 50001 };
+
+    		for (size_t l=0;l<sizeof(lengths)/sizeof(lengths[0]);l++) {
+    			long n = lengths[l];
+    			std::vector<gr_complex> in = random_samples(n, 3);
+    			fft_filterbank bank(decim, taps, centers, samplerate);
+    			std::vector<long> outlen(bank.num_channels(), 0);
+
+    			for (long pos=0, c=0;pos < n;c++) {
+    				long chunk = std::min(pushsizes[c % NUMPUSHSIZES], n - pos);
+    				bank.push(&in[pos], chunk);
+    				pos = pos + chunk;
+
+    				for (int ch=0;ch<bank.num_channels();ch++) {
+    					outlen[ch] += (long)bank.outqueue(ch).size();
+    					bank.outqueue(ch).clear();
+    				}
+    			}
+
+    			bank.flush();
+
+    			for (int ch=0;ch<bank.num_channels();ch++) {
+    				outlen[ch] += (long)bank.outqueue(ch).size();
+    				BOOST_CHECK_MESSAGE(outlen[ch] == (n + decim - 1) / decim, "decim " << decim << ", " << n
+    						<< " in: channel " << ch << " has " << outlen[ch] << " samples");
+    			}
+    		}
+    	}
+    }
+
+    BOOST_AUTO_TEST_CASE(t_fft_filterbank_passband) {
+    	// A tone just off each center comes out of that channel at full scale once the filter has filled
+    	int decim = 16;
+    	double samplerate = 1e6;
+    	double offset = 7000.0;
+    	long n = 100000;
+    	std::vector<float> taps = design_lowpass(1.0, samplerate, samplerate / (2.5 * decim),
+    			samplerate / (10.0 * decim));
+    	std::vector<double> centers;
+    	centers.push_back(-200000.0);
+    	centers.push_back(312345.0);
+
+    	for (size_t c=0;c<centers.size();c++) {
+    		std::vector<double> one(1, centers[c]);
+    		fft_filterbank bank(decim, taps, one, samplerate);
+    		std::vector<gr_complex> in(n);
+    		double w = 2.0 * M_PI * (centers[c] + offset) / samplerate;
+
+    		for (long i=0;i<n;i++)
+    			in[i] = gr_complex(cos(w * i), sin(w * i));
+
+    		bank.push(&in[0], n);
+    		bank.flush();
+
+    		std::vector<gr_complex> &out = bank.outqueue(0);
+    		BOOST_REQUIRE_EQUAL((long)out.size(), n / decim);
+
+    		long settle = (long)taps.size() / decim + 1;
+
+    		for (long i=settle;i<(long)out.size() - settle;i++) {
+    			if (std::abs(std::abs(out[i]) - 1.0f) > 0.02f)
+    				BOOST_FAIL("center " << centers[c] << ": sample " << i << " magnitude " << std::abs(out[i]));
+    		}
+    	}
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
@@ -0,0 +1,231 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sqlquery_impl.h"
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+
+namespace gr {
+  namespace sql {
+
+    mapped_window::~mapped_window() {
+    	if (base)
+    		munmap(base, length);
+    }
+
+    sqlquery::sptr
+    sqlquery::make(const std::string &sqlstring)
+    {
+      return sqlquery::sptr(new sqlquery_impl(sqlstring));
+    }
+
+    sqlquery_impl::sqlquery_impl(const std::string &sqlstring) {
+    	// Bad SQL, a missing file etc. throw from here (DATATYPE_QUERY) rather than exiting
+    	src.reset(new sqlsource_impl(sqlstring.c_str(), DATATYPE_QUERY, 1));
+
+    	std::string unsupported;
+
+    	switch (src->selectAction) {
+    	case SELECT_TIMELENGTH:
+    		unsupported = "TIMELENGTH";
+    	break;
+    	case SELECT_CONSTELLATION:
+    		unsupported = "CONSTELLATION";
+    	break;
+    	case SELECT_HEALTH:
+    		unsupported = "HEALTH";
+    	break;
+    	}
+
+    	if (src->shardcount > 0)
+    		unsupported = "SHARD INTO";
+    	else if (src->matchfile.length() > 0)
+    		unsupported = "WHERE MATCHES";
+    	else if (src->annotationlabel.length() > 0)
+    		unsupported = "WHERE ANNOTATION";
+
+    	if (unsupported.length() > 0)
+    		throw std::invalid_argument("sqlquery returns samples.  Use grsql for " + unsupported + ".");
+
+    	// Part of validating the query (ex: start past the end), so ValueError in Python too
+    	try {
+    		src->GetFileRange(startpos, endpos);
+    	}
+    	catch (std::runtime_error &e) {
+    		throw std::invalid_argument(e.what());
+    	}
+
+    	mappos = startpos;
+    }
+
+    sqlquery_impl::~sqlquery_impl() {
+    }
+
+    std::string sqlquery_impl::dtype() {
+    	if ((src->selectAction == SELECT_I) || (src->selectAction == SELECT_Q))
+    		return "float32";
+
+    	if (src->IsComplexOutput())
+    		return "complex64";
+
+    	switch (src->dataType) {
+    	case DATATYPE_FLOAT:
+    		return "float32";
+    	case DATATYPE_INT:
+    		return "int32";
+    	case DATATYPE_SHORT:
+    		return "int16";
+    	}
+
+    	return "uint8";
+    }
+
+    int sqlquery_impl::itemsize() {
+    	return src->GetOutputItemSize();
+    }
+
+    int sqlquery_impl::vlen() {
+    	return src->vlen;
+    }
+
+    double sqlquery_impl::sample_rate() {
+    	return src->outputrate;
+    }
+
+    long sqlquery_impl::num_items() {
+    	return (endpos - startpos) / src->datatypesize;
+    }
+
+    long sqlquery_impl::estimated_output_items() {
+    	// Rounded up plus a little slack for filter edge effects
+    	double ratio = src->outputrate / (double)src->samplerate;
+    	long n = (long)((double)num_items() * ratio) + 1;
+
+    	return n + src->vlen;
+    }
+
+    bool sqlquery_impl::zero_copy() {
+    	if (src->selectAction != SELECT_STAR)
+    		return false;
+
+    	if (src->cfilter || src->ffilter || src->filterbank)
+    		return false;
+
+    	return (src->convert == NULL);
+    }
+
+    void sqlquery_impl::MapRange() {
+    	mapping = std::make_shared<mapped_window>();
+
+    	if (endpos <= startpos)
+    		return;
+
+    	int fd = open(src->filename.c_str(), O_RDONLY);
+
+    	if (fd < 0)
+    		throw std::runtime_error("Unable to open input file " + src->filename);
+
+    	// mmap offsets have to be page aligned
+    	long pagesize = sysconf(_SC_PAGESIZE);
+    	long alignedstart = (startpos / pagesize) * pagesize;
+
+    	mapping->length = (size_t)(endpos - alignedstart);
+    	void *base = mmap(NULL, mapping->length, PROT_READ, MAP_SHARED, fd, alignedstart);
+    	close(fd);
+
+    	if (base == MAP_FAILED)
+    		throw std::runtime_error("Unable to memory map " + src->filename);
+
+    	mapping->base = base;
+    	mapping->data = (const unsigned char *)base + (startpos - alignedstart);
+
+    	madvise(base, mapping->length, MADV_SEQUENTIAL);
+    }
+
+    std::shared_ptr<const void> sqlquery_impl::map(long &nitems) {
+    	gr::thread::scoped_lock lock(query_mutex);
+
+    	if (!zero_copy())
+    		throw std::runtime_error("This query converts or filters samples, so it can't be memory mapped.  Use read() instead.");
+
+    	if (!mapping)
+    		MapRange();
+
+    	// Whole vectors only
+    	long remaining = (endpos - mappos) / src->datatypesize;
+    	nitems = (nitems / src->vlen) * src->vlen;
+
+    	if (nitems > remaining)
+    		nitems = remaining;
+
+    	if (nitems <= 0) {
+    		nitems = 0;
+    		return std::shared_ptr<const void>(mapping, (const void *)NULL);
+    	}
+
+    	const void *ptr = (const void *)(mapping->data + (mappos - startpos));
+    	mappos = mappos + nitems * src->datatypesize;
+
+    	// Shares ownership of the mapping
+    	return std::shared_ptr<const void>(mapping, ptr);
+    }
+
+    long sqlquery_impl::read(void *dest, long nitems) {
+    	gr::thread::scoped_lock lock(query_mutex);
+    	gr::thread::scoped_lock srclock(src->fp_mutex);
+
+    	if (!src->pInputFile)
+    		src->OpenInputFile();
+
+    	long nvectors = nitems / src->vlen;
+
+    	if (nvectors <= 0)
+    		return 0;
+
+    	// ReadVectors takes an int count, so go in pieces for very large reads
+    	long produced = 0;
+    	unsigned char *out = (unsigned char *)dest;
+    	long vectorsize = (long)src->GetOutputItemSize() * (long)src->vlen;
+
+    	while (produced < nvectors) {
+    		long n = nvectors - produced;
+
+    		if (n > (1L << 28))
+    			n = (1L << 28);
+
+    		int got = src->ReadVectors((int)n, (void *)&out[produced * vectorsize]);
+
+    		if (got <= 0)
+    			break;
+
+    		produced = produced + got;
+    	}
+
+    	return produced * src->vlen;
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
@@ -0,0 +1,74 @@
+/* -*- c++ -*- */
+/*
+ * Copyright 2017 ghostop14.
+ *
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_SQL_SQLQUERY_IMPL_H
+#define INCLUDED_SQL_SQLQUERY_IMPL_H
+
+#include <sql/sqlquery.h>
+#include "sqlsource_impl.h"
+
+namespace gr {
+  namespace sql {
+
+    // Read-only mapping of the selected byte range.  Unmapped when the last view goes away.
+    struct mapped_window
+    {
+    	void *base;
+    	size_t length;
+    	const unsigned char *data;  // first sample of the range
+
+    	mapped_window() : base(NULL), length(0), data(NULL) {}
+    	~mapped_window();
+    };
+
+    class SQL_API sqlquery_impl : public sqlquery
+    {
+     protected:
+    	std::unique_ptr<sqlsource_impl> src;
+    	gr::thread::mutex query_mutex;
+
+    	long startpos;
+    	long endpos;
+
+    	std::shared_ptr<mapped_window> mapping;
+    	long mappos;
+
+    	void MapRange();
+
+     public:
+      sqlquery_impl(const std::string &sqlstring);
+      ~sqlquery_impl();
+
+      std::string dtype();
+      int itemsize();
+      int vlen();
+      double sample_rate();
+      long num_items();
+      long estimated_output_items();
+
+      bool zero_copy();
+      std::shared_ptr<const void> map(long &nitems);
+      long read(void *dest, long nitems);
+    };
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_SQLQUERY_IMPL_H */
@@ -0,0 +1,533 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2017 ghostop14.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gnuradio/io_signature.h>
+#include "sqlsink_impl.h"
+#include "sqlsource_impl.h"
+#include "file_io.h"
+#include <regex>
+#include <boost/algorithm/string.hpp>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <climits>
+#include <cmath>
+#include <ctime>
+#include <volk/volk.h>
+
+namespace gr {
+  namespace sql {
+
+    sqlsink::sptr
+    sqlsink::make(const char *sqlstring, int igrcdatatype, int vlen)
+    {
+      int dsize=0;
+
+      switch(igrcdatatype) {
+      case DATATYPE_COMPLEX:
+    	  dsize = 8;
+      break;
+
+      case DATATYPE_FLOAT:
+      case DATATYPE_INT:
+    	  dsize = 4;
+      break;
+
+      case DATATYPE_SHORT:
+    	  dsize = 2;
+      break;
+
+      case DATATYPE_BYTE:
+    	  dsize = 1;
+      break;
+
+      default:
+    	  std::cout << "ERROR: sqlsink inputs can be complex, float, int, short or byte." << std::endl;
+    	  exit(1);
+      }
+
+      return gnuradio::get_initial_sptr
+        (new sqlsink_impl(sqlstring, igrcdatatype, dsize, vlen));
+    }
+
+    sqlsink_impl::sqlsink_impl(const char *csqlstring, int igrcdatatype, int dsize, int ivlen)
+      : gr::sync_block("sqlsink",
+              gr::io_signature::make(1, 1, dsize * (ivlen > 0 ? ivlen : 1)),
+              gr::io_signature::make(0, 0, 0)),
+        finishing(false), acceptedsamples(0), droppedsamples(0)
+    {
+    	sqlstring = csqlstring;
+    	grcdatatype = igrcdatatype;
+    	vlen = (ivlen > 0) ? ivlen : 1;
+    	insize = dsize;
+
+    	filename = "";
+    	dataType = DATATYPE_UNKNOWN;
+    	samplerate = 0;
+    	iopolicy = IOPOLICY_NORMAL;
+    	ringsize = DEFAULTRINGSIZE;
+    	preallocate = DEFAULTPREALLOCATE;
+    	rollbytes = 0;
+    	rollseconds = 0.0;
+
+    	ring = NULL;
+    	running = false;
+    	dropevents = 0;
+    	started = false;
+    	filesopened = 0;
+    	writerfailed = false;
+
+    	parsesql();
+
+    	datatypesize = GetDataTypeSize(dataType);
+
+    	// Rolling always happens on a whole vector
+    	long vectorbytes = (long)datatypesize * (long)vlen;
+
+    	if (rollseconds > 0.0) {
+    		rollbytes = llround(rollseconds * (double)samplerate) * (long)datatypesize;
+    	}
+
+    	if (rollbytes > 0) {
+    		rollbytes = (rollbytes / vectorbytes) * vectorbytes;
+
+    		if (rollbytes < vectorbytes)
+    			rollbytes = vectorbytes;
+    	}
+    }
+
+    sqlsink_impl::~sqlsink_impl()
+    {
+    	stop();
+
+    	if (ring)
+    		delete ring;
+    }
+
+    int sqlsink_impl::GetDataTypeSize(int dtype) {
+    	switch (dtype) {
+    	case DATATYPE_COMPLEX:
+    		return 8;
+    	case DATATYPE_FLOAT:
+    	case DATATYPE_INT:
+    	case DATATYPE_SC16:
+    		return 4;
+    	case DATATYPE_SHORT:
+    	case DATATYPE_SC8:
+    		return 2;
+    	}
+
+    	return 1;
+    }
+
+    void sqlsink_impl::parsesql() {
+    	if (sqlstring.length() == 0) {
+    		std::cout << "ERROR: Please provide a grsql INSERT string." << std::endl;
+    		exit(1);
+    	}
+
+		std::regex rgxinsert("^ *INSERT INTO '?(.*?)'",std::regex_constants::icase);
+		std::regex rgxdatatype(" ASDATATYPE ?(COMPLEX|FLOAT|INT|SHORT|BYTE|SC16|SC8|HACKRF|SIGNED8)",std::regex_constants::icase);
+		std::regex rgxsamplerate(" SAMPLERATE ?([0-9]{1,}\\.?[0-9]{0,}M?)",std::regex_constants::icase);
+		std::regex rgxiopolicy(" IOPOLICY ?(NORMAL|DROPBEHIND|DIRECT)",std::regex_constants::icase);
+		std::regex rgxbuffer(" BUFFER ?([0-9]{1,}\\.?[0-9]{0,}[KMG]?)",std::regex_constants::icase);
+		std::regex rgxpreallocate(" PREALLOCATE ?([0-9]{1,}\\.?[0-9]{0,}[KMG]?)",std::regex_constants::icase);
+		std::regex rgxroll(" ROLL EVERY ?([0-9]{1,}\\.?[0-9]{0,})( ?SECONDS| ?SEC|[KMG])?",std::regex_constants::icase);
+		std::smatch match;
+
+		if ( std::regex_search(sqlstring, match, rgxinsert) ) {
+			filename = match[1];
+		}
+		else {
+			std::cout << "ERROR: sqlsink needs INSERT INTO '<filename>' ASDATATYPE <type> SAMPLERATE <sps>" << std::endl;
+			exit(1);
+		}
+
+		if ( std::regex_search(sqlstring, match, rgxdatatype) ) {
+			std::string dtype=match[1];
+			boost::to_upper(dtype);
+
+			if (dtype == "COMPLEX") {
+				dataType = DATATYPE_COMPLEX;
+			} else if (dtype == "FLOAT") {
+				dataType = DATATYPE_FLOAT;
+			} else if (dtype == "INT") {
+				dataType = DATATYPE_INT;
+			} else if (dtype == "SHORT") {
+				dataType = DATATYPE_SHORT;
+			} else if (dtype == "BYTE") {
+				dataType = DATATYPE_BYTE;
+			} else if (dtype == "SC16") {
+				dataType = DATATYPE_SC16;
+			} else {
+				// HACKRF / SIGNED8 are the same layout as SC8
+				dataType = DATATYPE_SC8;
+			}
+		}
+		else {
+			std::cout << "No data type specified.  Please include ASDATATYPE [COMPLEX | FLOAT | INT | SHORT | BYTE | SC16 | SC8] in statement." << std::endl;
+			exit(1);
+		}
+
+		// Same type in and out, or complex packed down to SC16 / SC8 to cut the disk bandwidth
+		if ((dataType != grcdatatype) && !((grcdatatype == DATATYPE_COMPLEX) && ((dataType == DATATYPE_SC16) || (dataType == DATATYPE_SC8)))) {
+			std::cout << "ERROR: Your INSERT data type doesn't match the block's input type.  Complex input can also be recorded as SC16 or SC8." << std::endl;
+			exit(1);
+		}
+
+		if ( std::regex_search(sqlstring, match, rgxsamplerate) ) {
+			std::string srate=match[1];
+			samplerate = sqlsource_impl::ParseRate(srate);
+		}
+		else {
+			std::cout << "No sample rate specified.  Please include SAMPLERATE <sample rate> in statement. Sample rate may be specified as 10000000 or 10.2M" << std::endl;
+			exit(1);
+		}
+
+		if ( std::regex_search(sqlstring, match, rgxiopolicy) ) {
+			std::string spolicy=match[1];
+			boost::to_upper(spolicy);
+
+			if (spolicy == "DROPBEHIND")
+				iopolicy = IOPOLICY_DROPBEHIND;
+			else if (spolicy == "DIRECT")
+				iopolicy = IOPOLICY_DIRECT;
+			else
+				iopolicy = IOPOLICY_NORMAL;
+		}
+
+		if ( std::regex_search(sqlstring, match, rgxbuffer) ) {
+			std::string sbuffer=match[1];
+			ringsize = (long)sqlsource_impl::ParseFrequency(sbuffer);
+
+			if (ringsize < 2 * WRITERCHUNKSIZE) {
+				std::cout << "ERROR: BUFFER needs to be at least " << 2 * WRITERCHUNKSIZE << " bytes (ex: BUFFER 16M)." << std::endl;
+				exit(1);
+			}
+		}
+
+		if ( std::regex_search(sqlstring, match, rgxpreallocate) ) {
+			std::string sprealloc=match[1];
+			// 0 turns preallocation off
+			preallocate = (long)sqlsource_impl::ParseFrequency(sprealloc);
+		}
+
+		if ( std::regex_search(sqlstring, match, rgxroll) ) {
+			std::string sroll=match[1];
+			std::string sunits=match[2];
+			boost::to_upper(sunits);
+			boost::trim(sunits);
+
+			if (sunits.find("SEC") != std::string::npos)
+				rollseconds = atof(sroll.c_str());
+			else
+				rollbytes = (long)sqlsource_impl::ParseFrequency(sroll + sunits);
+
+			if ((rollseconds <= 0.0) && (rollbytes <= 0)) {
+				std::cout << "ERROR: ROLL EVERY needs a size (ex: 4G) or a time (ex: 60 SEC)." << std::endl;
+				exit(1);
+			}
+		}
+    }
+
+    std::string sqlsink_impl::RollFileName(int n) {
+    	if (rollbytes == 0)
+    		return filename;
+
+    	// capture.sigmf-data -> capture_0000.sigmf-data, capture_0001.sigmf-data, ...
+    	std::string base = filename;
+    	std::string ext = "";
+    	size_t dotpos = filename.find_last_of('.');
+    	size_t slashpos = filename.find_last_of('/');
+
+    	if ((dotpos != std::string::npos) && ((slashpos == std::string::npos) || (dotpos > slashpos))) {
+    		base = filename.substr(0, dotpos);
+    		ext = filename.substr(dotpos);
+    	}
+
+    	std::stringstream name;
+    	name << base << "_" << std::setw(4) << std::setfill('0') << n << ext;
+
+    	return name.str();
+    }
+
+    std::string sqlsink_impl::FormatTime(double secondsafterstart) {
+    	// ISO 8601 UTC with microseconds, as SigMF wants for core:datetime
+    	std::chrono::system_clock::time_point t = recordstart +
+    			std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::duration<double>(secondsafterstart));
+    	long long us = std::chrono::duration_cast<std::chrono::microseconds>(t.time_since_epoch()).count();
+    	time_t secs = (time_t)(us / 1000000);
+    	struct tm utc;
+    	gmtime_r(&secs, &utc);
+
+    	char buf[64];
+    	strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%S", &utc);
+
+    	std::stringstream str;
+    	str << buf << "." << std::setw(6) << std::setfill('0') << (us % 1000000) << "Z";
+
+    	return str.str();
+    }
+
+    void sqlsink_impl::WriteSidecar(std::string datafile, int64_t firstsample, int64_t nsamples) {
+    	// Each capture segment maps a sample in this file to its index in the incoming stream.
+    	// A new segment starts wherever samples were dropped.
+    	std::vector<record_gap> filegaps;
+    	int64_t droppedbefore = 0;
+
+    	{
+    		gr::thread::scoped_lock lock(gap_mutex);
+
+    		for (size_t g=0;g<gaps.size();g++) {
+    			if (gaps[g].sample <= firstsample)
+    				droppedbefore = droppedbefore + gaps[g].dropped;
+    			else if (gaps[g].sample < (firstsample + nsamples))
+    				filegaps.push_back(gaps[g]);
+    		}
+    	}
+
+    	std::string metafile = sqlsource_impl::SidecarFileName(datafile);
+    	std::ofstream meta(metafile);
+
+    	if (!meta.is_open()) {
+    		std::cout << "ERROR: Unable to write " << metafile << std::endl;
+    		return;
+    	}
+
+    	int64_t globalindex = firstsample + droppedbefore;
+
+    	meta << "{" << std::endl;
+    	meta << "  \"global\": {" << std::endl;
+    	meta << "    \"core:datatype\": \"" << sqlsource_impl::SigMFDataType(dataType) << "\"," << std::endl;
+    	meta << "    \"core:sample_rate\": " << samplerate << "," << std::endl;
+    	meta << "    \"core:version\": \"1.0.0\"," << std::endl;
+    	meta << "    \"core:recorder\": \"gr-sql sqlsink\"" << std::endl;
+    	meta << "  }," << std::endl;
+    	meta << "  \"captures\": [" << std::endl;
+    	meta << "    {\"core:sample_start\": 0, \"core:global_index\": " << globalindex
+    			<< ", \"core:datetime\": \"" << FormatTime((double)globalindex / (double)samplerate) << "\"}";
+
+    	for (size_t g=0;g<filegaps.size();g++) {
+    		droppedbefore = droppedbefore + filegaps[g].dropped;
+    		globalindex = filegaps[g].sample + droppedbefore;
+
+    		meta << "," << std::endl;
+    		meta << "    {\"core:sample_start\": " << filegaps[g].sample - firstsample << ", \"core:global_index\": " << globalindex
+    				<< ", \"core:datetime\": \"" << FormatTime((double)globalindex / (double)samplerate) << "\"}";
+    	}
+
+    	meta << std::endl << "  ]," << std::endl;
+    	meta << "  \"annotations\": []" << std::endl;
+    	meta << "}" << std::endl;
+    	meta.close();
+    }
+
+    void sqlsink_impl::WriterThread() {
+    	// Drains the ring to disk a chunk at a time, rolling files on a whole vector boundary.
+    	std::vector<unsigned char> chunk(WRITERCHUNKSIZE);
+    	record_file *out = NULL;
+    	std::string currentfile;
+    	int filenum = 0;
+    	int64_t filefirstsample = 0;
+    	long filebytes = 0;
+    	bool writeerror = false;
+
+    	while (true) {
+    		// Check for the finish before looking at the ring so nothing queued ahead of it is missed
+    		bool done = finishing.load();
+    		size_t avail = ring->readable();
+
+    		if ((avail == 0) && done)
+    			break;
+
+    		if ((avail < (size_t)WRITERCHUNKSIZE) && !done) {
+    			std::this_thread::sleep_for(std::chrono::microseconds(WRITERIDLEUS));
+    			continue;
+    		}
+
+    		size_t want = WRITERCHUNKSIZE;
+
+    		if ((rollbytes > 0) && (want > (size_t)(rollbytes - filebytes)))
+    			want = rollbytes - filebytes;
+
+    		size_t n = ring->read(&chunk[0], want);
+
+    		if (!out && !writerfailed.load()) {
+    			currentfile = RollFileName(filenum);
+    			out = new record_file(currentfile, iopolicy, preallocate);
+
+    			if (!out->is_open()) {
+    				// Can't exit from here with the scheduler running.  work() sees the flag and
+    				// finishes the recording.
+    				std::cout << "ERROR: Unable to open output file " << currentfile << ".  Stopping the recording." << std::endl;
+    				delete out;
+    				out = NULL;
+    				writerfailed = true;
+    			}
+    		}
+
+    		// Keep draining so work() never waits on a full ring
+    		if (!out)
+    			continue;
+
+    		if (!out->write(&chunk[0], n) && !writeerror) {
+    			std::cout << "ERROR: Write to " << currentfile << " failed (disk full?)." << std::endl;
+    			writeerror = true;
+    		}
+
+    		filebytes = filebytes + n;
+
+    		if ((rollbytes > 0) && (filebytes >= rollbytes)) {
+    			out->close();
+    			delete out;
+    			out = NULL;
+
+    			WriteSidecar(currentfile, filefirstsample, filebytes / datatypesize);
+
+    			filefirstsample = filefirstsample + filebytes / datatypesize;
+    			filebytes = 0;
+    			filenum++;
+    		}
+    	}
+
+    	if (out) {
+    		out->close();
+    		delete out;
+
+    		WriteSidecar(currentfile, filefirstsample, filebytes / datatypesize);
+    		filenum++;
+    	}
+
+    	filesopened = filenum;
+    }
+
+    bool sqlsink_impl::start() {
+    	if (running)
+    		return true;
+
+    	if (!ring)
+    		ring = new spsc_ring(ringsize);
+
+    	finishing = false;
+    	writerfailed = false;
+    	writer = std::thread(&sqlsink_impl::WriterThread, this);
+    	running = true;
+
+    	return true;
+    }
+
+    bool sqlsink_impl::stop() {
+    	if (!running)
+    		return true;
+
+    	finishing = true;
+    	writer.join();
+    	running = false;
+
+    	std::cout << "INFO: INSERT recorded " << acceptedsamples.load() << " samples to " << filesopened << " file(s)";
+
+    	if (droppedsamples.load() > 0)
+    		std::cout << ".  Dropped " << droppedsamples.load() << " samples in " << dropevents << " overflow(s) (marked in the sidecar captures)";
+
+    	if (writerfailed.load())
+    		std::cout << ".  Stopped early, samples after the last file that opened weren't written";
+
+    	std::cout << "." << std::endl;
+
+    	return true;
+    }
+
+    int
+    sqlsink_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+    	const unsigned char *in = (const unsigned char *)input_items[0];
+    	long nsamples = (long)noutput_items * (long)vlen;
+    	const unsigned char *src = in;
+
+    	if (writerfailed.load())
+    		return WORK_DONE;
+
+    	if (!started) {
+    		recordstart = std::chrono::system_clock::now();
+    		started = true;
+    	}
+
+    	if (dataType != grcdatatype) {
+    		// Complex float -> interleaved int16 / int8, same scaling SELECT uses to read it back
+    		size_t nbytes = nsamples * datatypesize;
+
+    		if (convbuffer.size() < nbytes)
+    			convbuffer.resize(nbytes);
+
+    		if (dataType == DATATYPE_SC16)
+    			volk_32f_s32f_convert_16i((int16_t *)&convbuffer[0], (const float *)in, (float)SHRT_MAX, 2*nsamples);
+    		else
+    			volk_32f_s32f_convert_8i((int8_t *)&convbuffer[0], (const float *)in, (float)SCHAR_MAX, 2*nsamples);
+
+    		src = &convbuffer[0];
+    	}
+
+    	// Take as many whole vectors as fit.  If the writer has fallen behind that far, drop the
+    	// rest rather than stall the flowgraph and mark the gap so the sidecar records it.
+    	long vectorbytes = (long)datatypesize * (long)vlen;
+    	long nvectors = ring->writable() / vectorbytes;
+
+    	if (nvectors > noutput_items)
+    		nvectors = noutput_items;
+
+    	if (nvectors > 0) {
+    		ring->write(src, nvectors * vectorbytes);
+    	}
+
+    	long nkept = nvectors * vlen;
+    	int64_t accepted = acceptedsamples.load() + nkept;
+
+    	if (nkept < nsamples) {
+    		gr::thread::scoped_lock lock(gap_mutex);
+    		long ndropped = nsamples - nkept;
+
+    		if (!gaps.empty() && (gaps.back().sample == accepted)) {
+    			gaps.back().dropped = gaps.back().dropped + ndropped;
+    		}
+    		else {
+    			record_gap gap;
+    			gap.sample = accepted;
+    			gap.dropped = ndropped;
+    			gaps.push_back(gap);
+    			dropevents++;
+    		}
+
+    		droppedsamples += ndropped;
+    	}
+
+    	acceptedsamples = accepted;
+
+    	return noutput_items;
+    }
+
+  } /* namespace sql */
+} /* namespace gr */
@@ -0,0 +1,118 @@
+/* -*- c++ -*- */
+/* 
+ * Copyright 2017 ghostop14.
+ * 
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ * 
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this software; see the file COPYING.  If not, write to
+ * the Free Software Foundation, Inc., 51 Franklin Street,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef INCLUDED_SQL_SQLSINK_IMPL_H
+#define INCLUDED_SQL_SQLSINK_IMPL_H
+
+#include <sql/sqlsink.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Default ring between work() and the writer thread
+#define DEFAULTRINGSIZE (256L * 1024L * 1024L)
+// Writer thread moves at most this much per write
+#define WRITERCHUNKSIZE (4L * 1024L * 1024L)
+// How long the writer sleeps when there's less than a chunk waiting
+#define WRITERIDLEUS 1000
+
+namespace gr {
+  namespace sql {
+
+    class spsc_ring;
+    class record_file;
+
+    // Samples dropped at one point in the recording (sample index in the file data)
+    struct record_gap
+    {
+    	int64_t sample;
+    	int64_t dropped;
+    };
+
+    class SQL_API sqlsink_impl : public sqlsink
+    {
+     protected:
+    	std::string sqlstring;
+    	int grcdatatype;  // input type
+    	int vlen;
+
+    	std::string filename;
+    	int dataType;     // as written
+    	long samplerate;
+    	int iopolicy;
+    	long ringsize;
+    	long preallocate;
+    	long rollbytes;   // 0 = one file
+    	double rollseconds;
+
+    	int insize;        // bytes per input sample
+    	int datatypesize;  // bytes per sample as written
+
+    	spsc_ring *ring;
+    	std::vector<unsigned char> convbuffer;
+
+    	std::thread writer;
+    	std::atomic<bool> finishing;
+    	std::atomic<bool> writerfailed;   // couldn't open an output file, work() ends the recording
+    	bool running;
+
+    	// work() side
+    	std::atomic<int64_t> acceptedsamples;
+    	std::atomic<int64_t> droppedsamples;
+    	long dropevents;
+    	bool started;
+    	std::chrono::system_clock::time_point recordstart;
+
+    	// gaps are rare, so they go through a mutex rather than the ring
+    	gr::thread::mutex gap_mutex;
+    	std::vector<record_gap> gaps;
+
+    	// writer side
+    	int filesopened;
+
+    	void parsesql();
+    	int GetDataTypeSize(int dtype);
+    	std::string RollFileName(int n);
+    	void WriterThread();
+    	void WriteSidecar(std::string datafile, int64_t firstsample, int64_t nsamples);
+    	std::string FormatTime(double secondsafterstart);
+
+     public:
+      sqlsink_impl(const char *sqlstring, int igrcdatatype, int dsize, int ivlen);
+      ~sqlsink_impl();
+
+      bool start();
+      bool stop();
+
+      long dropped() { return (long)droppedsamples.load(); }
+      long recorded() { return (long)acceptedsamples.load(); }
+
+      int work(int noutput_items,
+         gr_vector_const_void_star &input_items,
+         gr_vector_void_star &output_items);
+    };
+
+  } // namespace sql
+} // namespace gr
+
+#endif /* INCLUDED_SQL_SQLSINK_IMPL_H */
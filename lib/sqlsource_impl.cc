@@ -24,26 +24,37 @@
 
 #include <gnuradio/io_signature.h>
 #include "sqlsource_impl.h"
+#include "dsp_kernels.h"
+#include "file_io.h"
 #include <regex>
 #include <boost/algorithm/string.hpp>
 #include <sys/stat.h>
+#include <poll.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <iomanip>
+#include <climits>
+#include <cmath>
+#include <volk/volk.h>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <boost/thread/thread.hpp>
 using namespace std; // for regex ease
 
 namespace gr {
   namespace sql {
 
-#define SELECT_UNKNOWN 0
-#define SELECT_STAR 1
-#define SELECT_I 2
-#define SELECT_Q 3
-#define SELECT_TIMELENGTH 4
-
-
     sqlsource::sptr
-    sqlsource::make(const char *sqlstring, int igrcdatatype)
+    sqlsource::make(const char *sqlstring, int igrcdatatype, int vlen)
     {
       int dsize=0;
 
@@ -51,7 +62,10 @@ namespace gr {
       case DATATYPE_COMPLEX:
       case DATATYPE_SIGNED8:
       case DATATYPE_UNSIGNED8:
-    	  // Note that even though signed8/unsigned8 are byte inputs, they output complex.
+      case DATATYPE_SC16:
+      case DATATYPE_SC12:
+      case DATATYPE_SC8:
+    	  // Note that even though signed8/unsigned8 and the SCxx types are integer inputs, they output complex.
     	  // So output size is 8 / gr_complex.
     	  dsize = 8;
       break;
@@ -73,35 +87,112 @@ namespace gr {
       break;
       }
       return gnuradio::get_initial_sptr
-        (new sqlsource_impl(sqlstring,igrcdatatype,dsize));
+        (new sqlsource_impl(sqlstring,igrcdatatype,dsize,vlen));
     }
 
     /*
      * The private constructor
      */
-    sqlsource_impl::sqlsource_impl(const char *csqlstring,int igrcdatatype,int dsize)
+    sqlsource_impl::sqlsource_impl(const char *csqlstring,int igrcdatatype,int dsize,int ivlen)
       : gr::sync_block("sqlsource",
               gr::io_signature::make(0, 0, 0),
-              gr::io_signature::make(1, 1, dsize))
+              gr::io_signature::make(1, 2, dsize * (ivlen > 0 ? ivlen : 1)))
     {
     	grcdatatype = igrcdatatype;
+    	vlen = (ivlen > 0) ? ivlen : 1;
 
     	sqlstring = csqlstring;
     	sqlAction = GRSQL_UNKNOWN;
     	selectAction = SELECT_UNKNOWN;
     	filename = "";
     	outputfile = "";
+    	hasOutputFile = false;
     	dataType = DATATYPE_UNKNOWN;
     	samplerate = 0;
-    	starttime = 0.0;
-    	endtime = -1.0;
+    	startsample = 0;
+    	endsample = -1;
 
     	pInputFile = NULL;
+    	iopolicy = IOPOLICY_NORMAL;
+    	readahead = 0;
     	curfileposition = 0;
     	endfileposition = 0;
 
-    	if (grcdatatype > 0) {
-    		// Run from flowgraph, ignore SAVEAS
+    	resampletorate = 0;
+    	decimation = 0;
+    	resampletaps = 0;
+    	hascenter = false;
+    	centerfreq = 0.0;
+    	bandwidth = 0.0;
+    	filterbank = NULL;
+    	cfilter = NULL;
+    	ffilter = NULL;
+
+    	shardcount = 0;
+    	shardoverlap = 0;
+
+    	joinfile = "";
+    	joinoptions = "";
+    	joinoffset = "";
+    	joinoffsetnegative = false;
+    	joininterleave = false;
+
+    	matchfile = "";
+    	matchthreshold = 0.0;
+    	matchbefore = 0;
+    	matchafter = 0;
+    	matchtemplatenorm = 0.0;
+    	matchfftsize = 0;
+    	curmatchwindow = 0;
+    	nextmatchtag = 0;
+    	matchcancel = false;
+    	matchfailed = false;
+    	matchready = false;
+
+    	annotationlabel = "";
+    	annotationpad = 0;
+    	annotationsplit = false;
+    	nextannotationtag = 0;
+
+    	constellationbins = CONSTELLATIONDEFAULTBINS;
+    	constellationrange = 0.0;
+
+    	healthmindropout = HEALTHDEFAULTMINDROPOUT;
+    	healthmergegap = HEALTHDEFAULTMERGEGAP;
+
+    	follow = false;
+    	followlatency = 0;
+    	followidle = 0.0;
+    	followfd = -1;
+    	followinode = 0;
+
+    	realtime = false;
+    	speedup = 1.0;
+    	rtchunk = 0;
+    	rtitemrate = 0.0;
+    	rtstarted = false;
+    	rtitems = 0;
+    	rttotalitems = 0;
+    	rtunderruns = 0;
+    	rtmaxlate = 0.0;
+    	rtdrift = 0.0;
+
+    	throwerrors = (grcdatatype == DATATYPE_QUERY);
+    	setupdone = false;
+
+    	try {
+    		Setup(dsize);
+    	}
+    	catch (...) {
+    		// Only the query API gets here.  Don't leak what was set up before the error.
+    		Release();
+    		throw;
+    	}
+    }
+
+    void sqlsource_impl::Setup(int dsize) {
+    	if ((grcdatatype > 0) || (grcdatatype == DATATYPE_QUERY)) {
+    		// Run from flowgraph or the query API, ignore SAVEAS
         	parsesql(true);
     	}
     	else {
@@ -138,8 +229,8 @@ namespace gr {
     	}
 
     	if (bDataError) {
-    		std::cout << "ERROR: Your SQL and your flowgraph have mismatched data types.  Please check and try again." << std::endl;
-    		exit(1);
+    		ErrorOut() << "ERROR: Your SQL and your flowgraph have mismatched data types.  Please check and try again." << std::endl;
+    		ErrorExit();
     	}
 
     	if ((outputfile.length()) > 0) {
@@ -148,501 +239,3815 @@ namespace gr {
 
 		filesize = GetFileSize(filename);
 		datatypesize = GetDataTypeSize();
+		convert = get_convert_kernel(dataType, selectAction);
 
 		numdatapoints = filesize / (long)datatypesize;
 
-		numsec = (float)numdatapoints / (float)samplerate;
-    }
+		numsec = (double)numdatapoints / (double)samplerate;
+		outputrate = (double)samplerate;
 
-    int sqlsource_impl::runsql() {
-    	if (selectAction == SELECT_TIMELENGTH) {
+		if ((resampletorate > 0) || (decimation > 0) || hascenter || (channelcenters.size() > 0)) {
+			SetupFilters();
+		}
 
-    		if (outputfile.length() == 0) {
-        		std::cout << "Time length of recording: " << std::fixed << std::setw(11) <<
-        				std::setprecision(6) << numsec << " seconds (" << numsec / 60.0 << ") min"<< std::endl;
-    		}
-    		else {
-    			  ofstream outfile;
-    			  try {
-        			  outfile.open(outputfile);
-    			  }
-    			  catch (...) {
-    				  std::cout << "ERROR: Unable to write to " << outputfile << std::endl;
-    				  exit(1);
-    			  }
+		if (joinfile.length() > 0) {
+			SetupJoin();
+		}
 
-    			  outfile << "Time length of recording: " << std::fixed << std::setw(11) <<
-          				std::setprecision(6) << numsec << " seconds (" << numsec / 60.0 << ") min"<< std::endl;
-    			  outfile.close();
-    		}
+		if (matchfile.length() > 0) {
+			LoadMatchTemplate();
+		}
 
-    	}
-    	else {
-    		// need to seek to the specified time position
-    		// Know the time difference in bytes (data size * sample rate * time difference)
-    		// write those bytes to output file.
-    		// If length goes beyond the end of the input file or if endtime = -1.0 just write the remaining file.
-    		try {
-    			pInputFile = fopen ( filename.c_str() , "rb" );
-    		}
-    		catch(...) {
-    			std::cout << "ERROR: Unable to open input file " << filename << std::endl;
-    		}
-    		FILE * pOutputFile;
-    		try {
-    			pOutputFile = fopen ( outputfile.c_str() , "wb" );
-    		}
-    		catch(...) {
-    			std::cout << "ERROR: Unable to open output file " << outputfile << std::endl;
-    		}
+		if (annotationlabel.length() > 0) {
+			LoadAnnotations();
+		}
 
-    		long startpos = (long)((float)datatypesize * starttime * samplerate);
+		if (grcdatatype > 0) {
+			SetSchedulerHints(dsize);
 
-    		if (startpos > (filesize - datatypesize)) {
-    			std::cout << "ERROR: start time is at or past the end of the file." << std::endl;
-    			exit(1);
-    		}
+			if (realtime)
+				SetupRealtime();
+		}
 
-			fseek ( pInputFile , startpos , SEEK_SET );
+		setupdone = true;
+    }
 
-    		long endpos;
+    void sqlsource_impl::Release() {
+    	if (cfilter) {
+    		delete cfilter;
+    		cfilter = NULL;
+    	}
 
-    		if (endtime == -1.0) {
-    			endpos = filesize;
-    		}
-    		else {
-    			endpos = (long)((float)datatypesize * endtime * samplerate);
+    	if (ffilter) {
+    		delete ffilter;
+    		ffilter = NULL;
+    	}
 
-    			if (endpos > filesize) {
-    				endpos = filesize;
-    			}
-    		}
+    	if (filterbank) {
+    		delete filterbank;
+    		filterbank = NULL;
+    	}
 
-    		// Let's use a 16K buffer to move through * blocks faster.
-    		// Each file read will take some time so it's more efficient to do them in blocks.
+    	joined.reset();
 
-    		size_t bytes_read = 0;
+    	if (pInputFile) {
+    		delete pInputFile;
+    		pInputFile = NULL;
+    	}
 
-    		long i=startpos;
-    		long bytesremaining;
-    		long totalbytesread = 0; // used for debugging
+    	if (followfd >= 0) {
+    		close(followfd);
+    		followfd = -1;
+    	}
+    }
 
-    		// We're using a while here so we can dyamically adjust our step
-    		// depending on if we're in bulk * mode or I/Q mode where we have
-    		// to go 1 data set at a time to separate out the I and Q channels
-			float newVal;  // Just instantiate on stack once if we need it for signed/unsigned8
+    std::ostream &sqlsource_impl::ErrorOut() {
+    	if (throwerrors)
+    		return errormessage;
 
-    		while (i<endpos) {
+    	return std::cout;
+    }
 
-    			if (selectAction == SELECT_STAR) {
-    				// read in bigger blocks
-    				bytesremaining = endpos - i;
+    void sqlsource_impl::ErrorExit() {
+    	if (!throwerrors)
+    		exit(1);
 
-    				if (bytesremaining >= FILEREADBLOCKSIZE)
-    					bytes_read = fread(&buffer, 1, FILEREADBLOCKSIZE, pInputFile);
-    				else
-    					bytes_read = fread(&buffer, 1, bytesremaining, pInputFile);
+    	std::string msg = errormessage.str();
+    	errormessage.str("");
 
-    				totalbytesread = totalbytesread + bytes_read;
+    	if (msg.compare(0, 7, "ERROR: ") == 0)
+    		msg = msg.substr(7);
 
-    				if ((dataType != DATATYPE_SIGNED8) && (dataType != DATATYPE_UNSIGNED8)) {
-            			fwrite(buffer,1,bytes_read,pOutputFile);
-    				}
-    				else {
-    					// have to do a quick conversion first.
-    					// Calculations mirrored from csdr library for signed/unsigned -> float
-
-    					// Note, this will DEFINITELY take longer to process for conversion
-    					// rather than just read->write.
-    					for (long j=0;j<bytes_read;j++) {
-    						if (dataType == DATATYPE_UNSIGNED8) {
-    							// unsigned8 / rtl_sdr
-    							newVal = ((float)buffer[j])/((float)UCHAR_MAX/2.0)-1.0;
-    						}
-    						else {
-    							// signed8 / hackrf
-    							newVal = ((float)((signed char)buffer[j]))/(float)SCHAR_MAX;
-    						}
-    						fwrite((void *)&newVal,1,4,pOutputFile);
-    					}
-    				}
+    	while ((msg.length() > 0) && (msg[msg.length()-1] == '\n'))
+    		msg.erase(msg.length()-1);
 
-    				i = i + bytes_read;
-    			}
-    			else {
-    				// read in a complex data set at a time so we can split them out.
-        			bytes_read = fread(&buffer, 1, datatypesize, pInputFile);
-
-    				if (selectAction == SELECT_I) {
-    					// write first float
-            			fwrite(buffer,1,4,pOutputFile);
-    				} else if (selectAction == SELECT_Q) {
-    					// write second float
-            			fwrite(&buffer[4],1,4,pOutputFile);
-    				}
+    	if (!setupdone)
+    		throw std::invalid_argument(msg);
 
-        			i = i + datatypesize;
-    			}
-    		}
+    	throw std::runtime_error(msg);
+    }
 
-			fclose ( pInputFile );
-			pInputFile = NULL;
-			fclose ( pOutputFile );
-    	}
+    bool sqlsource_impl::FollowFile() {
+    	// FOLLOW: reading has caught up with the recorder.  Waits for the file to grow past
+    	// endfileposition (true) or for following to end (false): the requested end was
+    	// reached, IDLE passed without growth, or the file was removed / renamed.
+    	if ((endsample != -1) && (endfileposition >= (long)(endsample * (int64_t)datatypesize)))
+    		return false;
 
-    	return 0;
-    }
+#ifdef __linux__
+    	if (followfd < 0) {
+    		followfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
 
-    bool sqlsource_impl::stop() {
-    	if (pInputFile) {
-            gr::thread::scoped_lock lock(fp_mutex); // hold for the rest of this function
-    		fclose(pInputFile);
-    		pInputFile = NULL;
+    		if ((followfd >= 0) && (inotify_add_watch(followfd, filename.c_str(), IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF) < 0)) {
+    			close(followfd);
+    			followfd = -1;
+    		}
     	}
+#endif
 
-        return true;
-    }
+    	struct stat stat_buf;
 
-    /*
-     * Our virtual destructor.
-     */
-    sqlsource_impl::~sqlsource_impl()
-    {
-    	stop();
-    }
+    	// Which file we're following, so a rename or replacement shows up too
+    	if ((followinode == 0) && (stat(filename.c_str(), &stat_buf) == 0))
+    		followinode = (unsigned long)stat_buf.st_ino;
 
-    void sqlsource_impl::parsesql(bool ignore_nosaveas) {
-    	// This function breaks down the SQL statement into its representative components and does any initialization such as making sure the input file
-    	// exists and opening the file pointer.
+    	std::chrono::steady_clock::time_point idlestart = std::chrono::steady_clock::now();
+    	std::chrono::steady_clock::time_point firstgrowth;
+    	bool grown = false;
+    	bool gone = false;
 
-    	if (sqlstring.length() == 0) {
-    		std::cout << "ERROR: Please provide a grsql SQL string." << std::endl;
-    		exit(1);
-    	}
+    	while (true) {
+    		// Our descriptor keeps an unlinked file alive, so look at the path itself
+    		long size = -1;
 
-		std::regex rgxselect("SELECT ?(\\*|I|Q|WATERFALL|FREQUENCY|CONSTELLATION|TIMELENGTH)",std::regex_constants::icase);
-		std::regex rgxfile(" FROM '?(.*?)'",std::regex_constants::icase);
-		std::regex rgxdatatype(" ASDATATYPE ?(COMPLEX|FLOAT|INT|SHORT|BYTE|HACKRF|RTLSDR|SIGNED8|UNSIGNED8)",std::regex_constants::icase);
-		std::regex rgxsamplerate(" SAMPLERATE ?([0-9]{1,}\\.?[0-9]{0,}M?)",std::regex_constants::icase);
-		std::regex rgxstarttime(" STARTTIME ?([0-9]{1,}\\.?[0-9]{0,})",std::regex_constants::icase);
-		std::regex rgxendtime(" ENDTIME ?([0-9]{1,}\\.?[0-9]{0,})",std::regex_constants::icase);
-		std::regex rgxsaveas(" SAVEAS '?(.*?)'",std::regex_constants::icase);
-		std::smatch match;
+    		if ((stat(filename.c_str(), &stat_buf) == 0) && ((unsigned long)stat_buf.st_ino == followinode))
+    			size = stat_buf.st_size;
+    		else
+    			gone = true;
 
-		// Find if we have a SELECT or INSERT
-    	if ( std::regex_search(sqlstring, match, rgxselect) ) {
-    		// SELECT CLAUSE
-    	        //std::cout << "Found SELECT clause\n";
-    	        std::string strselectaction=match[1];
-    	        boost::to_upper(strselectaction);
-    	        // std::cout << "matched string = " << selectaction << '\n';
-    	        if (strselectaction == "TIMELENGTH") {
-    	        	selectAction = SELECT_TIMELENGTH;
-    	        } else if (strselectaction == "*") {
-    	        	selectAction = SELECT_STAR;
-				} else if (strselectaction == "I") {
-					selectAction = SELECT_I;
-				} else if (strselectaction == "Q") {
-					selectAction = SELECT_Q;
-				}
-				else {
-					std::cout << "ERROR: Unknown select action: " << strselectaction << std::endl;
-					exit(1);
-				}
-    	        // Find the filename:
-    	    	if ( std::regex_search(sqlstring, match, rgxfile) ) {
-    	    	        filename=match[1];
-    	    	        // std::cout << "filename: " << filename << std::endl;
+    		if (size > filesize) {
+    			filesize = size;
+    			numdatapoints = filesize / (long)datatypesize;
+    			numsec = (double)numdatapoints / (double)samplerate;
+    		}
 
-    	    	        // now see if file exists:
-    	    			std::ifstream infile;
+    		int64_t lastsample = numdatapoints;
 
-    	    			try {
-    	    				infile.open (filename);
-    	    			}
-    	    			catch (...) {
-    	    				std::cout << "ERROR opening file: " << filename << std::endl;
-    	    				exit(1);
-    	    			}
+    		if ((endsample != -1) && (endsample < lastsample))
+    			lastsample = endsample;
 
-    	    			infile.close();
-    			}
-    			else {
-    				std::cout << "No source file found.  Please include FROM '<filename>' in statement (or did you forget the quotes?)." << std::endl;
-    				exit(1);
+    		long endpos = (long)(lastsample * (int64_t)datatypesize);
+    		int timeoutms = -1;
+
+    		if (endpos > endfileposition) {
+    			if (!grown) {
+    				grown = true;
+    				firstgrowth = std::chrono::steady_clock::now();
     			}
 
-    	    	// Data Type
-    	    	if ( std::regex_search(sqlstring, match, rgxdatatype) ) {
-    	    	        std::string dtype=match[1];
-    	    	        boost::to_upper(dtype);
-    	    	        // std::cout << "data type = " << dtype << '\n';
-    	    	        if (dtype == "COMPLEX") {
-    	    	        	dataType = DATATYPE_COMPLEX;
-    	    	        } else if (dtype == "FLOAT") {
-    	    	        	dataType = DATATYPE_FLOAT;
-    					} else if (dtype == "INT") {
-    						dataType = DATATYPE_INT;
-    					} else if (dtype == "SHORT") {
-    						dataType = DATATYPE_SHORT;
-						} else if (dtype == "BYTE") {
-							dataType = DATATYPE_BYTE;
-						} else if ((dtype == "HACKRF") || (dtype == "SIGNED8")) {
-							dataType = DATATYPE_SIGNED8;
-						} else if ((dtype == "RTLSDR") || (dtype == "UNSIGNED8")) {
-							dataType = DATATYPE_UNSIGNED8;
-						}
-						else {
-							std::cout << "ERROR: Unknown data type: " << dtype << std::endl;
-							exit(1);
-						}
+    			// LATENCY: hold out for a full read block, but no longer than that
+    			double waited = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - firstgrowth).count();
 
-    	    	        if ( ((selectAction == SELECT_I) || (selectAction == SELECT_Q)) && (dataType != DATATYPE_COMPLEX) ) {
-    	    	        	std::cout << "ERROR: SELECT I/Q only available for complex data types.  If working with Signed/Unsigned8 data types, use SaveAS first to convert it to copmlex then extract I/Q." << std::endl;
-    	    	        	exit(1);
-    	    	        }
-    			}
-    			else {
-    				std::cout << "No data type specified.  Please include ASDATATYPE [COMPLEX | FLOAT | INT | SHORT | BYTE | HACKRF (alias for SIGNED8) | RTLSDR (alias for UNSIGNED8) | SIGNED8 | UNSIGNED8 ] in statement." << std::endl;
-    				exit(1);
+    			if ((followlatency <= 0) || (endpos - endfileposition >= FILEREADBLOCKSIZE) || (lastsample == endsample) || gone || (waited >= followlatency)) {
+    				endfileposition = endpos;
+    				// Clears the reader's end of file so the new data is read
+    				pInputFile->seek(curfileposition);
+    				return true;
     			}
 
-    	    	// Sample Rate
-    	    	if ( std::regex_search(sqlstring, match, rgxsamplerate) ) {
-    	    	        std::string srate=match[1];
+    			timeoutms = (int)ceil(followlatency - waited);
+    		}
+    		else if (gone) {
+    			std::cout << "INFO: FOLLOW: " << filename << " was removed or renamed.  Stopping." << std::endl;
+    			return false;
+    		}
+    		else if (followidle > 0.0) {
+    			double idle = std::chrono::duration<double>(std::chrono::steady_clock::now() - idlestart).count();
 
-    	    	        if (srate.find("M") != std::string::npos) {
-    	    	        	boost::replace_all(srate,"M","");
-    	    	        	samplerate = atof(srate.c_str()) * 1000000.0;
-    	    	        }
-    	    	        else {
-    	    	        	samplerate = atof(srate.c_str());
-    	    	        }
-    	    	        // std::cout << "sample rate = " << samplerate << " SPS" << std::endl;
-    			}
-    			else {
-    				std::cout << "No sample rate specified.  Please include SAMPLERATE <sample rate> in statement. Sample rate may be specified as 10000000 or 10.2M" << std::endl;
-    				exit(1);
+    			if (idle >= followidle) {
+    				std::cout << "INFO: FOLLOW: " << filename << " hasn't grown in " << followidle << " sec.  Stopping." << std::endl;
+    				return false;
     			}
-    	    	// Start time
-    	    	if ( std::regex_search(sqlstring, match, rgxstarttime) ) {
-    	    	        std::string srate=match[1];
 
-	    	        	starttime = atof(srate.c_str());
-    	    	        // std::cout << "sample rate = " << samplerate << " SPS" << std::endl;
-    			}
-    			else {
-    				if (selectAction != SELECT_TIMELENGTH) {
-        				std::cout << "No start time specified.  Please include starttime <time as float sec> in statement." << std::endl;
-        				exit(1);
-    				}
-    			}
+    			timeoutms = (int)ceil((followidle - idle) * 1000.0);
+    		}
 
-    	    	// end time
-    	    	if ( std::regex_search(sqlstring, match, rgxendtime) ) {
-    	    	        std::string srate=match[1];
+    		// Wake up now and then regardless so a flowgraph stop isn't held up
+    		int maxwait = (followfd >= 0) ? FOLLOWWAKEMS : FOLLOWPOLLMS;
 
-	    	        	endtime = atof(srate.c_str());
-    	    	        // std::cout << "sample rate = " << samplerate << " SPS" << std::endl;
-    			}
-    			else {
-    				if (selectAction != SELECT_TIMELENGTH) {
-        				std::cout << "INFO: No end time specified.  Assuming end of file." << std::endl;
-    				}
-    			}
+    		if ((timeoutms < 0) || (timeoutms > maxwait))
+    			timeoutms = maxwait;
 
-    	    	// save as
-    	    	if ( std::regex_search(sqlstring, match, rgxsaveas) ) {
-    	    	        outputfile=match[1];
-    	    	        // std::cout << "output file: " << outputfile << std::endl;
-    			}
-    			else {
-    				if ((selectAction != SELECT_TIMELENGTH) && (!ignore_nosaveas)) {
-        				std::cout << "No output file found.  Please include SAVEAS '<filename>' in statement (or did you forget the quotes?)." << std::endl;
-        				exit(1);
+    		if (followfd >= 0) {
+    			struct pollfd pfd;
+    			pfd.fd = followfd;
+    			pfd.events = POLLIN;
+    			pfd.revents = 0;
+
+    			if ((poll(&pfd, 1, timeoutms) > 0) && (pfd.revents & POLLIN)) {
+#ifdef __linux__
+    				char events[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    				ssize_t len;
+
+    				while ((len = read(followfd, events, sizeof(events))) > 0) {
+    					const struct inotify_event *event;
+
+    					for (char *p = events; p < events + len; p += sizeof(struct inotify_event) + event->len) {
+    						event = (const struct inotify_event *)p;
+
+    						if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+    							gone = true;
+    					}
     				}
+#endif
     			}
+    		}
+    		else {
+    			std::this_thread::sleep_for(std::chrono::milliseconds(timeoutms));
+    		}
 
-		}
-		else {
-			std::cout << "No select clause found." << std::endl;
-			exit(1);
-		}
-
-    	// Fields are populated.
+    		// Flowgraph stopping (a no-op from the command-line)
+    		boost::this_thread::interruption_point();
+    	}
     }
 
-    long sqlsource_impl::GetFileSize(std::string filename)
-    {
-        struct stat stat_buf;
-        int rc = stat(filename.c_str(), &stat_buf);
-        return rc == 0 ? stat_buf.st_size : -1;
-    }
+    void sqlsource_impl::SetupRealtime() {
+    	// CHUNK is in samples, work() deals in vectors
+    	rtitemrate = outputrate * speedup / (double)vlen;
 
-    int sqlsource_impl::GetDataTypeSize() {
-    	int retVal = 1;
+    	long chunksamples = rtchunk;
+    	if (chunksamples <= 0)
+    		chunksamples = (long)(outputrate * speedup * REALTIMEDEFAULTCHUNKSEC);
 
-    	switch (dataType) {
-    	case DATATYPE_COMPLEX:
-    		retVal = 8;
-    	break;
+    	rtchunk = chunksamples / vlen;
 
-    	case DATATYPE_FLOAT:
-    		retVal = 4;
-    	break;
+    	// Has to stay a multiple of the output multiple or the scheduler won't call us.
+    	int multiple = output_multiple();
+    	rtchunk = ((rtchunk + multiple - 1) / multiple) * multiple;
+    	if (rtchunk < multiple)
+    		rtchunk = multiple;
 
-    	case DATATYPE_INT:
-    		retVal = 4;
-    	break;
+    	// Don't let the scheduler hand us (and us hand downstream) more than a chunk at a time.
+    	set_max_noutput_items((int)rtchunk);
+    	set_min_output_buffer(2 * rtchunk);
 
-    	case DATATYPE_SHORT:
-    		retVal = 2;
-    	break;
+    	std::cout << "INFO: REALTIME playback at " << std::fixed << std::setprecision(0) << outputrate * speedup << " sps in chunks of " << rtchunk * vlen << " samples." << std::endl;
+    }
 
-    	case DATATYPE_BYTE:
-    	case DATATYPE_SIGNED8:
-    	case DATATYPE_UNSIGNED8:
-    		retVal = 1;
-    	break;
+    void sqlsource_impl::PaceOutput(long nitems) {
+    	// Hold each chunk until the moment its last sample would have come off the air.
+    	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    	if (!rtstarted) {
+    		rtstart = now;
+    		rtplaystart = now;
+    		rtstarted = true;
     	}
 
-    	return retVal;
-    }
+    	rtitems = rtitems + nitems;
+    	rttotalitems = rttotalitems + nitems;
 
-    int
-    sqlsource_impl::work(int noutput_items,
-        gr_vector_const_void_star &input_items,
-        gr_vector_void_star &output_items)
-    {
-        gr::thread::scoped_lock lock(fp_mutex); // hold for the rest of this function
+    	std::chrono::steady_clock::time_point target = rtstart +
+    			std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>((double)rtitems / rtitemrate));
 
-    	int returnedItems=0;
+    	if (now < target) {
+    		// A plain sleep can overshoot by the scheduler tick, so sleep short and spin the last bit.
+    		std::chrono::steady_clock::time_point wake = target - std::chrono::microseconds(REALTIMESPINUS);
 
-       	if ((hasOutputFile) > 0) {
-    		std::cout << "ERROR: output file not allowed in GR-SQL when running from a block.  Use the command-line grsql tool instead." << std::endl;
-    		exit(1);
-    	}
-    	// If the file isn't already open, let's open it and set our start position
-    	if (!pInputFile) {
-    		try {
-    			pInputFile = fopen ( filename.c_str() , "rb" );
-    		}
-    		catch(...) {
-    			std::cout << "ERROR: Unable to open input file " << filename << std::endl;
-    		}
+    		if (now < wake)
+    			std::this_thread::sleep_until(wake);
 
-    		long startpos = (long)((float)datatypesize * starttime * samplerate);
+    		while (std::chrono::steady_clock::now() < target)
+    			std::this_thread::yield();
 
-    		if (startpos > (filesize - datatypesize)) {
-    			std::cout << "ERROR: start time is at or past the end of the file." << std::endl;
-    			exit(1);
-    		}
+    		now = std::chrono::steady_clock::now();
+    	}
 
-    		curfileposition = startpos;
+    	double late = std::chrono::duration<double>(now - target).count();
 
-    		fseek ( pInputFile , startpos , SEEK_SET );
+    	if (late > rtmaxlate)
+    		rtmaxlate = late;
 
-    		if (endtime == -1.0) {
-    			endfileposition = filesize;
-    		}
-    		else {
-    			endfileposition = (long)((float)datatypesize * endtime * samplerate);
+    	rtdrift = (late > 0.0) ? late : 0.0;
 
-    			if (endfileposition > filesize) {
-    				endfileposition = filesize;
+    	// Badly behind (slow consumer or disk stall).  Rather than burst to catch up, count it
+    	// and restart the clock from here.
+    	if (late > (double)(REALTIMEMAXLATECHUNKS * rtchunk) / rtitemrate) {
+    		rtunderruns++;
+    		rtstart = now;
+    		rtitems = 0;
+    	}
+    }
+
+    void sqlsource_impl::SetSchedulerHints(int dsize) {
+    	// What the scheduler sees as one item (a whole vector if VLEN > 1)
+    	int itemsize = dsize * vlen;
+
+    	// Keep every work() call starting on a VOLK aligned boundary so downstream
+    	// kernels can take their aligned paths.
+    	int alignitems = (int)(volk_get_alignment() / itemsize);
+    	if (alignitems < 1)
+    		alignitems = 1;
+
+    	set_alignment(alignitems);
+    	set_output_multiple(alignitems);
+
+    	// Room for a full read block per call (double buffered) means fewer, larger work() calls.
+    	long readitems = FILEREADBLOCKSIZE / itemsize;
+    	if (readitems < alignitems)
+    		readitems = alignitems;
+
+    	set_min_output_buffer(2 * readitems);
+    }
+
+    int sqlsource_impl::GetOutputItemSize() {
+    	// Size of a single output sample (not vector) after any conversion
+    	if ((selectAction == SELECT_I) || (selectAction == SELECT_Q))
+    		return sizeof(float);
+
+    	if (IsComplexOutput())
+    		return sizeof(gr_complex);
+
+    	return datatypesize;
+    }
+
+    void sqlsource_impl::AlignToVectors(long &startpos, long &endpos) {
+    	// VLEN: start on a frame boundary (relative to the start of the recording) and only
+    	// hand out whole frames.  With a filter in the chain the frames are counted on the
+    	// filter output instead.
+    	if ((vlen <= 1) || cfilter || ffilter || filterbank)
+    		return;
+
+    	long framebytes = (long)vlen * (long)datatypesize;
+    	long alignedstart = (startpos / framebytes) * framebytes;
+
+    	if (alignedstart != startpos) {
+    		std::cout << "INFO: Start moved back " << (startpos - alignedstart) / datatypesize << " samples to the VLEN " << vlen << " frame boundary." << std::endl;
+    		startpos = alignedstart;
+    	}
+
+    	endpos = startpos + ((endpos - startpos) / framebytes) * framebytes;
+    }
+
+    bool sqlsource_impl::IsComplexOutput() {
+    	return ((selectAction == SELECT_STAR) || (selectAction == SELECT_CONSTELLATION)) && ((dataType == DATATYPE_COMPLEX) || (dataType == DATATYPE_SIGNED8) ||
+    			(dataType == DATATYPE_UNSIGNED8) || IsPackedComplex());
+    }
+
+    int sqlsource_impl::GetChannelDecimation(bool powerof2) {
+    	// Output rate has to be above the bandwidth (by CHANNELOVERSAMPLE) for the filter's
+    	// transition band.  Rounding down to a power of 2 only raises the output rate.
+    	long decim = (long)((double)samplerate / (CHANNELOVERSAMPLE * bandwidth));
+
+    	if (decim < 1)
+    		decim = 1;
+
+    	if (powerof2) {
+    		long p = next_power_of_2(decim);
+
+    		if (p > decim)
+    			p = p >> 1;
+
+    		decim = p;
+    	}
+
+    	return (int)decim;
+    }
+
+    void sqlsource_impl::SetupFilters() {
+    	long interp;
+    	long decim;
+
+    	if (hascenter || (channelcenters.size() > 0)) {
+    		if (!IsComplexOutput()) {
+    			ErrorOut() << "ERROR: CENTER and CHANNELS AT are only available with SELECT * on complex data." << std::endl;
+    			ErrorExit();
+    		}
+
+    		if ((resampletorate > 0) || (decimation > 0)) {
+    			ErrorOut() << "ERROR: CENTER / CHANNELS AT already decimate to the BANDWIDTH.  Please don't combine them with RESAMPLE TO or DECIMATE." << std::endl;
+    			ErrorExit();
+    		}
+
+    		if ((bandwidth <= 0.0) || (bandwidth > (double)samplerate)) {
+    			ErrorOut() << "ERROR: CENTER / CHANNELS AT need a BANDWIDTH greater than 0 and no more than the sample rate." << std::endl;
+    			ErrorExit();
+    		}
+
+    		std::vector<double> centers = channelcenters;
+    		if (hascenter)
+    			centers.push_back(centerfreq);
+
+    		for (size_t c=0;c<centers.size();c++) {
+    			if (fabs(centers[c]) > ((double)samplerate / 2.0)) {
+    				ErrorOut() << "ERROR: Channel center " << centers[c] << " Hz is outside the recording (+/- " << samplerate / 2 << " Hz)." << std::endl;
+    				ErrorExit();
     			}
     		}
+
+    		// The filterbank's small inverse FFTs need a power of 2 decimation
+    		int chandecim = GetChannelDecimation(channelcenters.size() > 0);
+    		double outrate = (double)samplerate / (double)chandecim;
+
+    		// Flat to bandwidth/2 and stopped by outrate - bandwidth/2, so nothing aliases back into
+    		// the channel.  Only a decimation of 1 (BANDWIDTH close to the sample rate) can leave
+    		// less room than that, and then nothing aliases anyway.
+    		double transition = outrate - bandwidth;
+    		if (transition < (0.1 * bandwidth))
+    			transition = 0.1 * bandwidth;
+
+    		std::vector<float> taps = design_lowpass(1.0, (double)samplerate, bandwidth / 2.0 + transition / 2.0, transition);
+
+    		if (channelcenters.size() > 0) {
+    			filterbank = new fft_filterbank(chandecim, taps, centers, (double)samplerate);
+    		}
+    		else {
+    			cfilter = new freq_xlating_decimator(chandecim, taps, centerfreq, (double)samplerate);
+    		}
+
+    		outputrate = outrate;
+    		std::cout << "INFO: Channel output sample rate is " << std::fixed << std::setprecision(1) << outrate << " SPS (decimation " << chandecim << ")" << std::endl;
+
+        	filterbuffer.resize(FILEREADBLOCKSIZE);
+    		return;
     	}
 
-		// Let's use a 16K buffer to move through * blocks faster.
-		// Each file read will take some time so it's more efficient to do them in blocks.
+    	if (decimation > 0) {
+    		interp = 1;
+    		decim = decimation;
+    	}
+    	else {
+    		long g = gcd_long(resampletorate, samplerate);
+    		interp = resampletorate / g;
+    		decim = samplerate / g;
+    	}
 
-		size_t bytes_read = 0;
-		long bytesremaining;
-		long bytesrequested = noutput_items * datatypesize;
+    	if ((interp > MAXRESAMPLEFACTOR) || (decim > MAXRESAMPLEFACTOR)) {
+    		ErrorOut() << "ERROR: The resample ratio " << interp << "/" << decim << " is too complex.  Please pick a rate with a simpler ratio to the sample rate." << std::endl;
+    		ErrorExit();
+    	}
 
-		// We're using a while here so we can dyamically adjust our step
-		// depending on if we're in bulk * mode or I/Q mode where we have
-		// to go 1 data set at a time to separate out the I and Q channels
-		if (curfileposition < endfileposition) {
-			bytesremaining = endfileposition - curfileposition;
+    	bool complexout = IsComplexOutput();
+    	bool floatout = (dataType == DATATYPE_FLOAT) || (selectAction == SELECT_I) || (selectAction == SELECT_Q);
 
-			if (selectAction == SELECT_STAR) {
-				// read in bigger blocks
-		    	// gr_complex *out = (gr_complex *) output_items[0];
-				// Don't know the data type so go generic.
-		    	void *out = (void *) output_items[0];
+    	std::vector<float> taps = rational_resampler<float>::design_taps((int)interp, (int)decim, resampletaps);
+    	outputrate = (double)samplerate * (double)interp / (double)decim;
 
-				if (bytesremaining >= bytesrequested)
-					bytes_read = fread(&buffer, 1, bytesrequested, pInputFile);
-				else
-					bytes_read = fread(&buffer, 1, bytesremaining, pInputFile);
+    	if (complexout) {
+    		cfilter = new rational_resampler<gr_complex>((int)interp, (int)decim, taps);
+    	}
+    	else if (floatout) {
+    		ffilter = new rational_resampler<float>((int)interp, (int)decim, taps);
+    	}
+    	else {
+    		ErrorOut() << "ERROR: RESAMPLE and DECIMATE are only available for complex and float output." << std::endl;
+    		ErrorExit();
+    	}
 
-				curfileposition = curfileposition + bytes_read;
+    	// Sized in bytes, enough native items to keep each read in big blocks
+    	filterbuffer.resize(FILEREADBLOCKSIZE);
+    }
 
-				returnedItems = (int)(bytes_read / datatypesize);
+    int sqlsource_impl::SaveChannels() {
+    	// One read pass feeds every channel.  Each channel goes to its own file with the
+    	// channel number ahead of the extension (out.raw -> out_0.raw, out_1.raw, ...)
+    	std::vector<file_writer *> outfiles;
+    	std::string base;
+    	std::string ext;
+    	SplitOutputFileName(base, ext);
+
+    	for (int c=0;c<filterbank->num_channels();c++) {
+    		std::string chanfile = base + "_" + std::to_string(c) + ext;
+    		file_writer *pOutputFile = new file_writer(chanfile, iopolicy, readahead);
+
+    		if (!pOutputFile->is_open()) {
+    			ErrorOut() << "ERROR: Unable to open output file " << chanfile << std::endl;
+    			ErrorExit();
+    		}
 
-				if ((dataType != DATATYPE_SIGNED8) && (dataType != DATATYPE_UNSIGNED8)) {
-					memcpy((void *)out,(const void *)buffer,bytes_read);
-				}
-				else {
-					// have to do a quick conversion first.
-					// Calculations mirrored from csdr library for signed/unsigned -> float
-
-					// Note, this will DEFINITELY take longer to process for conversion
-					// rather than just read->write.
-					float newVal;
-					// Even though it's complex out, we're rolling through the
-					// individual I and Q's as incremental floats.
-			    	float *floatout = (float *) output_items[0];
-					for (long j=0;j<bytes_read;j++) {
-						if (dataType == DATATYPE_UNSIGNED8) {
-							// unsigned8 / rtl_sdr
-							newVal = ((float)buffer[j])/((float)UCHAR_MAX/2.0)-1.0;
-						}
-						else {
-							// signed8 / hackrf
-							newVal = ((float)((signed char)buffer[j]))/(float)SCHAR_MAX;
-						}
-						floatout[j] = newVal;
-					}
-				}
+    		std::cout << "INFO: Channel " << c << " (" << channelcenters[c] << " Hz) -> " << chanfile << std::endl;
+    		outfiles.push_back(pOutputFile);
+    	}
+
+		OpenInputFile();
+
+		gr_complex *staging = (gr_complex *)&filterbuffer[0];
+		int stagingitems = (int)(filterbuffer.size() / sizeof(gr_complex));
+		int n;
+		bool more = true;
+
+		while (more) {
+			n = ReadItems(stagingitems, (void *)staging);
+
+			if (n > 0) {
+				filterbank->push(staging, n);
 			}
 			else {
-				// For I or Q, we're reading complex but writing out float.
-				// So bytesrequested is 1/2 the bytes we need to read.
-				long bytestoread = 2 * bytesrequested;
-				long bytesprocessed = 0;
-				int i=0;
-		    	float *out = (float *) output_items[0];
-
-				while ((curfileposition < endfileposition) && (bytesprocessed < bytestoread)) {
-					// read in a complex data set at a time so we can split them out.
-					bytes_read = fread(&buffer, 1, datatypesize, pInputFile);
-
-					if (bytes_read > 0) {
-						if (selectAction == SELECT_I) {
-							// write first float
-							memcpy(&out[i],buffer,4);
-						} else if (selectAction == SELECT_Q) {
-							// write second float
-							memcpy(&out[i],&buffer[4],4);
-						}
-					}
-					else {
-						// just a safety check
-						out[i] = 0.0;
-					}
+				// Last partial block
+				filterbank->flush();
+				more = false;
+			}
 
-					bytesprocessed = bytesprocessed + datatypesize;
-					i = i + 1;
+			for (int c=0;c<filterbank->num_channels();c++) {
+				std::vector<gr_complex> &q = filterbank->outqueue(c);
 
-					curfileposition = curfileposition + datatypesize;
+				if (q.size() > 0) {
+					outfiles[c]->write(&q[0], sizeof(gr_complex), q.size());
+					q.clear();
 				}
+			}
+		}
+
+		delete pInputFile;
+		pInputFile = NULL;
+
+		for (size_t c=0;c<outfiles.size();c++)
+			delete outfiles[c];
+
+		return 0;
+    }
+
+    int sqlsource_impl::SaveFiltered() {
+    	// Resampled (and FOLLOW) extracts run through the same read path the block uses.
+		file_writer *pOutputFile = new file_writer(outputfile, iopolicy, readahead);
+
+		if (!pOutputFile->is_open()) {
+			ErrorOut() << "ERROR: Unable to open output file " << outputfile << std::endl;
+			ErrorExit();
+		}
+
+		OpenInputFile();
+
+		long vectorsize = (long)GetOutputItemSize() * (long)vlen;
+		long nvectors = FILEREADBLOCKSIZE / vectorsize;
+
+		if (nvectors < 1)
+			nvectors = 1;
+
+		std::vector<unsigned char> outbuffer(nvectors * vectorsize);
+		int n;
+
+		while ((n = ReadVectors((int)nvectors, (void *)&outbuffer[0])) > 0) {
+			pOutputFile->write(&outbuffer[0], vectorsize, n);
+		}
+
+		delete pInputFile;
+		pInputFile = NULL;
+		delete pOutputFile;
+
+		return 0;
+    }
+
+    int sqlsource_impl::runsql() {
+    	if (selectAction == SELECT_TIMELENGTH) {
+
+    		if (outputfile.length() == 0) {
+        		std::cout << "Time length of recording: " << std::fixed << std::setw(11) <<
+        				std::setprecision(6) << numsec << " seconds (" << numsec / 60.0 << ") min"<< std::endl;
+        		std::cout << "Samples in recording: " << numdatapoints << std::endl;
+    		}
+    		else {
+    			  ofstream outfile;
+    			  try {
+        			  outfile.open(outputfile);
+    			  }
+    			  catch (...) {
+    				  ErrorOut() << "ERROR: Unable to write to " << outputfile << std::endl;
+    				  ErrorExit();
+    			  }
+
+    			  outfile << "Time length of recording: " << std::fixed << std::setw(11) <<
+          				std::setprecision(6) << numsec << " seconds (" << numsec / 60.0 << ") min"<< std::endl;
+    			  outfile << "Samples in recording: " << numdatapoints << std::endl;
+    			  outfile.close();
+    		}
+
+    	}
+    	else if (selectAction == SELECT_CONSTELLATION) {
+    		SaveConstellation();
+    	}
+    	else if (selectAction == SELECT_HEALTH) {
+    		return SaveHealth();
+    	}
+    	else if (shardcount > 0) {
+    		SaveShards();
+    	}
+    	else if (joined) {
+    		SaveJoined();
+    	}
+    	else if (matchfile.length() > 0) {
+    		SaveMatches();
+    	}
+    	else if (annotationlabel.length() > 0) {
+    		SaveAnnotations();
+    	}
+    	else if (filterbank) {
+    		SaveChannels();
+    	}
+    	else if (cfilter || ffilter || follow) {
+    		SaveFiltered();
+    	}
+    	else {
+    		// need to seek to the specified time position
+    		// Know the time difference in bytes (data size * sample rate * time difference)
+    		// write those bytes to output file.
+    		// If length goes beyond the end of the input file or if endtime = -1.0 just write the remaining file.
+    		pInputFile = new file_reader(filename, iopolicy, readahead);
+
+    		if (!pInputFile->is_open()) {
+    			ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    			ErrorExit();
+    		}
+
+    		file_writer *pOutputFile = new file_writer(outputfile, iopolicy, readahead);
+
+    		if (!pOutputFile->is_open()) {
+    			ErrorOut() << "ERROR: Unable to open output file " << outputfile << std::endl;
+    			ErrorExit();
+    		}
+
+    		long startpos;
+    		long endpos;
+
+    		GetFileRange(startpos, endpos);
+    		CopyRange(pInputFile, pOutputFile, startpos, endpos);
+
+			delete pInputFile;
+			pInputFile = NULL;
+			delete pOutputFile;
+    	}
+
+    	return 0;
+    }
+
+    void sqlsource_impl::CopyRange(file_reader *reader, file_writer *writer, long startpos, long endpos) {
+    	// Writes [startpos, endpos) of the input in the SELECT's output format.  Only local
+    	// buffers are used so shards can run this in parallel.
+
+    	// Packed types (SC12) aren't a power of 2 so keep each read on a whole sample boundary
+    	long readblocksize = (FILEREADBLOCKSIZE / datatypesize) * datatypesize;
+    	std::vector<unsigned char> block(readblocksize);
+    	// Worst case is 2 floats out per sample (packed / signed8 / unsigned8)
+    	std::vector<float> conv(2 * (readblocksize / datatypesize));
+    	int outitemsize = GetOutputItemSize();
+
+		reader->seek(startpos);
+
+		size_t bytes_read = 0;
+		long i=startpos;
+		long bytesremaining;
 
-				returnedItems = (bytesprocessed / datatypesize);
+		while (i<endpos) {
+			bytesremaining = endpos - i;
+
+			if (bytesremaining >= readblocksize)
+				bytes_read = reader->read(&block[0], readblocksize);
+			else
+				bytes_read = reader->read(&block[0], bytesremaining);
+
+			if (bytes_read == 0) {
+				// Short file / read error.  Don't spin.
+				break;
+			}
+
+			long numsamples = bytes_read / datatypesize;
+
+			if (convert) {
+				convert(&block[0], numsamples, (void *)&conv[0]);
+				writer->write(&conv[0],outitemsize,numsamples);
+			}
+			else {
+				writer->write(&block[0],1,bytes_read);
 			}
+
+			i = i + bytes_read;
 		}
+    }
+
+    void sqlsource_impl::SplitOutputFileName(std::string &base, std::string &ext) {
+    	// out.raw -> out, .raw.  Numbered outputs go in between (out_0.raw, out_1.raw, ...)
+    	base = outputfile;
+    	ext = "";
+    	size_t dotpos = outputfile.find_last_of('.');
+    	size_t slashpos = outputfile.find_last_of('/');
+
+    	if ((dotpos != std::string::npos) && ((slashpos == std::string::npos) || (dotpos > slashpos))) {
+    		base = outputfile.substr(0, dotpos);
+    		ext = outputfile.substr(dotpos);
+    	}
+    }
+
+    // Worker threads can't use ErrorExit(): exit() would run static destructors under the
+    // other workers and an exception can't leave a std::thread.  Workers record the first
+    // failure here instead and the calling thread reports it after join().
+    struct worker_failure
+    {
+    	std::atomic<bool> failed;
+    	boost::mutex failure_mutex;
+    	std::string message;
+
+    	worker_failure() : failed(false) {}
+
+    	void set(const std::string &msg) {
+    		gr::thread::scoped_lock lock(failure_mutex);
+
+    		if (!failed.load()) {
+    			message = msg;
+    			failed = true;
+    		}
+    	}
+    };
+
+    static int WorkerThreads() {
+    	int nthreads = (int)std::thread::hardware_concurrency();
+
+    	if (nthreads < 1)
+    		nthreads = 1;
+
+    	return nthreads;
+    }
+
+    bool sqlsource_impl::OpenWorkerReaders(int count, std::vector< std::unique_ptr<file_reader> > &readers) {
+    	// On the calling thread, so a missing file is reported before any worker starts
+    	readers.clear();
+
+    	for (int t=0;t<count;t++) {
+    		readers.push_back(std::unique_ptr<file_reader>(new file_reader(filename, iopolicy, readahead)));
+
+    		if (!readers.back()->is_open()) {
+    			readers.clear();
+    			return false;
+    		}
+    	}
+
+    	return true;
+    }
+
+    long sqlsource_impl::ReadSamples(file_reader &reader, long nsamples, std::vector<unsigned char> &raw, std::vector<unsigned char> &converted, gr_complex *out) {
+    	// Up to nsamples from the reader's position as complex (float output gets Q = 0).  raw /
+    	// converted are the caller's scratch so worker threads don't share anything.
+    	int itemsize = GetOutputItemSize();
+    	bool complexout = IsComplexOutput();
+
+    	if ((long)raw.size() < nsamples * datatypesize)
+    		raw.resize(nsamples * datatypesize);
+
+    	if ((long)converted.size() < nsamples * itemsize)
+    		converted.resize(nsamples * itemsize);
+
+    	size_t bytes_read = reader.read(&raw[0], nsamples * datatypesize);
+    	long nread = (long)(bytes_read / datatypesize);
+
+    	if (complexout) {
+    		// Straight into the caller's buffer
+    		if (convert)
+    			convert(&raw[0], nread, (void *)out);
+    		else
+    			memcpy(out, &raw[0], nread * sizeof(gr_complex));
+    	}
+    	else {
+    		if (convert)
+    			convert(&raw[0], nread, (void *)&converted[0]);
+    		else
+    			memcpy(&converted[0], &raw[0], nread * itemsize);
+
+    		const float *in = (const float *)&converted[0];
+
+    		for (long j=0;j<nread;j++)
+    			out[j] = gr_complex(in[j], 0.0f);
+    	}
+
+    	return nread;
+    }
+
+    int sqlsource_impl::SaveConstellation() {
+    	// One streaming pass: chunks of the range are binned in parallel, each thread into its
+    	// own histogram, merged into the 64-bit total as each chunk finishes.
+    	long startpos;
+    	long endpos;
+
+    	GetFileRange(startpos, endpos);
+
+    	int64_t firstsample = startpos / datatypesize;
+    	int64_t nsamples = (endpos - startpos) / datatypesize;
+    	long blocksamples = FILEREADBLOCKSIZE / datatypesize;
+
+    	if (constellationrange <= 0.0) {
+    		// AUTO: a little past the largest I or Q near the start of the range
+    		file_reader reader(filename, iopolicy, readahead);
+
+    		if (!reader.is_open()) {
+    			ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    			ErrorExit();
+    		}
+
+    		std::vector<unsigned char> raw;
+    		std::vector<unsigned char> converted;
+    		std::vector<gr_complex> samples(blocksamples);
+    		int64_t scanned = 0;
+    		float peak = 0.0f;
+
+    		reader.seek(startpos);
+
+    		while ((scanned < nsamples) && (scanned < CONSTELLATIONAUTOSAMPLES)) {
+    			long n = blocksamples;
+
+    			if (n > nsamples - scanned)
+    				n = (long)(nsamples - scanned);
+
+    			n = ReadSamples(reader, n, raw, converted, &samples[0]);
+
+    			if (n <= 0)
+    				break;
+
+    			for (long j=0;j<n;j++) {
+    				// NaN / inf are left for the histogram to count as outside
+    				float ival = fabs(samples[j].real());
+    				float qval = fabs(samples[j].imag());
+
+    				if (std::isfinite(ival) && (ival > peak))
+    					peak = ival;
+
+    				if (std::isfinite(qval) && (qval > peak))
+    					peak = qval;
+    			}
+
+    			scanned = scanned + n;
+    		}
+
+    		constellationrange = (peak > 0.0f) ? 1.1 * (double)peak : 1.0;
+    	}
+
+    	std::cout << "INFO: CONSTELLATION " << constellationbins << " x " << constellationbins << " bins over +/- " << constellationrange << std::endl;
+
+    	int nthreads = WorkerThreads();
+    	int64_t chunksize = nsamples / (nthreads * MATCHCHUNKSPERTHREAD);
+
+    	if (chunksize < blocksamples)
+    		chunksize = blocksamples;
+
+    	if (chunksize > CONSTELLATIONMAXCHUNK)
+    		chunksize = CONSTELLATIONMAXCHUNK;
+
+    	int nchunks = (int)((nsamples + chunksize - 1) / chunksize);
+
+    	if (nthreads > nchunks)
+    		nthreads = nchunks;
+
+    	// Readers are opened here: the workers can't ErrorExit()
+    	std::vector< std::unique_ptr<file_reader> > readers;
+
+    	if (!OpenWorkerReaders(nthreads, readers)) {
+    		ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    		ErrorExit();
+    	}
+
+    	size_t nbins = (size_t)constellationbins * (size_t)constellationbins;
+    	std::vector<uint64_t> total(nbins, 0);
+    	uint64_t outside = 0;
+    	boost::mutex total_mutex;
+    	std::atomic<int> nextchunk(0);
+    	worker_failure failed;
+    	std::vector<std::thread> workers;
+
+    	for (int t=0;t<nthreads;t++) {
+    		file_reader *reader = readers[t].get();
+
+    		workers.push_back(std::thread([this, reader, &total, &outside, &total_mutex, &nextchunk, &failed, nchunks, chunksize, firstsample, nsamples, blocksamples]() {
+    			try {
+    				iq_histogram hist(constellationbins, (float)constellationrange);
+    				std::vector<unsigned char> raw;
+    				std::vector<unsigned char> converted;
+    				std::vector<gr_complex> samples(blocksamples);
+    				int c;
+
+    				while (((c = nextchunk++) < nchunks) && !failed.failed.load()) {
+    					int64_t pos = (int64_t)c * chunksize;
+    					int64_t chunkend = pos + chunksize;
+
+    					if (chunkend > nsamples)
+    						chunkend = nsamples;
+
+    					reader->seek((long)((firstsample + pos) * datatypesize));
+
+    					while (pos < chunkend) {
+    						long n = blocksamples;
+
+    						if (n > chunkend - pos)
+    							n = (long)(chunkend - pos);
+
+    						n = ReadSamples(*reader, n, raw, converted, &samples[0]);
+
+    						if (n <= 0) {
+    							// The range was checked against the file size at setup
+    							failed.set("Unable to read " + filename + " at sample " + std::to_string(firstsample + pos) + ".  Was it truncated?");
+    							return;
+    						}
+
+    						hist.add(&samples[0], n);
+    						pos = pos + n;
+    					}
+
+    					gr::thread::scoped_lock lock(total_mutex);
+    					outside = outside + hist.merge_into(total);
+    				}
+    			}
+    			catch (std::exception &e) {
+    				failed.set(std::string("CONSTELLATION: ") + e.what());
+    			}
+    		}));
+    	}
+
+    	for (size_t t=0;t<workers.size();t++)
+    		workers[t].join();
+
+    	readers.clear();
+
+    	if (failed.failed.load()) {
+    		ErrorOut() << "ERROR: " << failed.message << std::endl;
+    		ErrorExit();
+    	}
+
+    	if (outside > 0) {
+    		std::cout << "INFO: " << outside << " samples (" << std::fixed << std::setprecision(3) << 100.0 * (double)outside / (double)nsamples
+    				<< "%) were outside +/- " << constellationrange << " and aren't counted.  Use RANGE to widen it." << std::endl;
+    	}
+
+    	std::string base;
+    	std::string ext;
+    	SplitOutputFileName(base, ext);
+    	boost::to_lower(ext);
+
+    	ofstream outfile(outputfile, std::ios::binary);
+
+    	if (!outfile.is_open()) {
+    		ErrorOut() << "ERROR: Unable to write to " << outputfile << std::endl;
+    		ErrorExit();
+    	}
+
+    	if (ext == ".pgm") {
+    		// 8-bit greyscale image, log scaled so sparse areas still show.  +Q is up.
+    		uint64_t maxcount = 0;
+
+    		for (size_t b=0;b<nbins;b++) {
+    			if (total[b] > maxcount)
+    				maxcount = total[b];
+    		}
+
+    		double logmax = log1p((double)maxcount);
+    		std::vector<unsigned char> row(constellationbins);
+
+    		outfile << "P5" << std::endl;
+    		outfile << "# grsql CONSTELLATION " << filename << " range +/- " << constellationrange << " samples " << nsamples << std::endl;
+    		outfile << constellationbins << " " << constellationbins << std::endl << "255" << std::endl;
+
+    		for (int q=constellationbins-1;q>=0;q--) {
+    			for (int i=0;i<constellationbins;i++) {
+    				uint64_t count = total[(size_t)q * constellationbins + i];
+    				row[i] = (logmax > 0.0) ? (unsigned char)lround(255.0 * log1p((double)count) / logmax) : 0;
+    			}
+
+    			outfile.write((const char *)&row[0], constellationbins);
+    		}
+    	}
+    	else {
+    		// Raw uint64 counts, row-major: row = Q bin (from -RANGE), column = I bin
+    		outfile.write((const char *)&total[0], nbins * sizeof(uint64_t));
+    	}
+
+    	outfile.close();
+
+    	std::cout << "INFO: Wrote the " << constellationbins << " x " << constellationbins << " constellation of " << nsamples << " samples to " << outputfile << std::endl;
+
+    	return 0;
+    }
+
+    int sqlsource_impl::SaveHealth() {
+    	// One pass over the range, chunks scanned in parallel (each thread with its own reader),
+    	// then ranges that ran across chunk boundaries are joined back up.
+    	long startpos;
+    	long endpos;
+
+    	GetFileRange(startpos, endpos);
+
+    	int64_t firstsample = startpos / datatypesize;
+    	int64_t nsamples = (endpos - startpos) / datatypesize;
+    	long blocksamples = FILEREADBLOCKSIZE / datatypesize;
+
+    	int nthreads = WorkerThreads();
+    	int64_t chunksize = nsamples / (nthreads * MATCHCHUNKSPERTHREAD);
+
+    	if (chunksize < blocksamples)
+    		chunksize = blocksamples;
+
+    	int nchunks = (int)((nsamples + chunksize - 1) / chunksize);
+
+    	if (nthreads > nchunks)
+    		nthreads = nchunks;
+
+    	// Readers are opened here: the workers can't ErrorExit()
+    	std::vector< std::unique_ptr<file_reader> > readers;
+
+    	if (!OpenWorkerReaders(nthreads, readers)) {
+    		ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    		ErrorExit();
+    	}
+
+    	std::vector<health_range> found;
+    	boost::mutex found_mutex;
+    	std::atomic<int> nextchunk(0);
+    	worker_failure failed;   // also stops the other workers
+    	std::vector<std::thread> workers;
+
+    	for (int t=0;t<nthreads;t++) {
+    		file_reader *reader = readers[t].get();
+
+    		workers.push_back(std::thread([this, reader, &found, &found_mutex, &nextchunk, &failed, nchunks, chunksize, firstsample, nsamples]() {
+    			try {
+    				std::vector<health_range> chunkfound;
+    				int c;
+
+    				while (((c = nextchunk++) < nchunks) && !failed.failed.load()) {
+    					int64_t chunkstart = firstsample + (int64_t)c * chunksize;
+    					int64_t chunkend = chunkstart + chunksize;
+
+    					if (chunkend > firstsample + nsamples)
+    						chunkend = firstsample + nsamples;
+
+    					chunkfound.clear();
+
+    					if (!HealthChunk(*reader, chunkstart, chunkend, chunkfound)) {
+    						failed.set("Unable to read " + filename + " around sample " + std::to_string(chunkstart) + ".  Was it truncated?");
+    						return;
+    					}
+
+    					gr::thread::scoped_lock lock(found_mutex);
+    					found.insert(found.end(), chunkfound.begin(), chunkfound.end());
+    				}
+    			}
+    			catch (std::exception &e) {
+    				failed.set(std::string("HEALTH: ") + e.what());
+    			}
+    		}));
+    	}
+
+    	for (size_t t=0;t<workers.size();t++)
+    		workers[t].join();
+
+    	readers.clear();
+
+    	if (failed.failed.load()) {
+    		ErrorOut() << "ERROR: " << failed.message << std::endl;
+    		ErrorExit();
+    	}
+
+    	// Join each type's ranges across chunk boundaries, then drop the short zero runs
+    	std::sort(found.begin(), found.end(), [](const health_range &a, const health_range &b) {
+    		return (a.type != b.type) ? (a.type < b.type) : (a.start < b.start);
+    	});
+
+    	std::vector<health_range> merged;
+
+    	for (size_t r=0;r<found.size();r++) {
+    		int64_t gap = (found[r].type == HEALTH_ZERO) ? 0 : healthmergegap;
+
+    		if ((merged.size() > 0) && (merged.back().type == found[r].type) && (found[r].start - merged.back().end <= gap)) {
+    			if (found[r].end > merged.back().end)
+    				merged.back().end = found[r].end;
+
+    			merged.back().count = merged.back().count + found[r].count;
+    		}
+    		else {
+    			merged.push_back(found[r]);
+    		}
+    	}
+
+    	found.clear();
+
+    	int64_t clipped = 0;
+    	int64_t dropped = 0;
+    	int64_t nonfinite = 0;
+
+    	for (size_t r=0;r<merged.size();r++) {
+    		if ((merged[r].type == HEALTH_ZERO) && (merged[r].end - merged[r].start < healthmindropout))
+    			continue;
+
+    		found.push_back(merged[r]);
+
+    		if (merged[r].type == HEALTH_CLIPPED)
+    			clipped = clipped + merged[r].count;
+    		else if (merged[r].type == HEALTH_ZERO)
+    			dropped = dropped + merged[r].count;
+    		else
+    			nonfinite = nonfinite + merged[r].count;
+    	}
+
+    	std::sort(found.begin(), found.end(), [](const health_range &a, const health_range &b) {
+    		return (a.start != b.start) ? (a.start < b.start) : (a.type < b.type);
+    	});
+
+    	std::cout << "INFO: HEALTH scanned " << nsamples << " samples.  Clipped: " << clipped << ", in dropouts: " << dropped << ", NaN/inf: " << nonfinite
+    			<< " (" << found.size() << " range(s))" << std::endl;
+
+    	if (!hasOutputFile) {
+    		WriteHealthReport(std::cout, nsamples, found);
+    	}
+    	else {
+    		ofstream report(outputfile);
+
+    		if (!report.is_open()) {
+    			ErrorOut() << "ERROR: Unable to write to " << outputfile << std::endl;
+    			ErrorExit();
+    		}
+
+    		WriteHealthReport(report, nsamples, found);
+    		report.close();
+
+    		std::cout << "INFO: Wrote the health report to " << outputfile << std::endl;
+    	}
+
+    	// Non-zero exit for scripts when anything was found
+    	return (found.size() > 0) ? 2 : 0;
+    }
+
+    bool sqlsource_impl::HealthChunk(file_reader &reader, int64_t chunkstart, int64_t chunkend, std::vector<health_range> &found) {
+    	// Runs of each flag in [chunkstart, chunkend).  Short zero runs are dropped here unless
+    	// they touch either end of the chunk (they may continue in the next one).  Runs on a
+    	// worker thread: returns false if the chunk can't be read instead of exiting.
+    	const int types[3] = { HEALTH_CLIPPED, HEALTH_ZERO, HEALTH_NONFINITE };
+    	health_kernel kernel = get_health_kernel(dataType);
+    	long blocksamples = FILEREADBLOCKSIZE / datatypesize;
+    	std::vector<unsigned char> raw(blocksamples * datatypesize);
+    	std::vector<unsigned char> flags(blocksamples);
+    	health_range open[3];
+    	bool isopen[3] = { false, false, false };
+
+    	if (!reader.seek((long)(chunkstart * datatypesize)))
+    		return false;
+
+    	int64_t pos = chunkstart;
+
+    	while (pos < chunkend) {
+    		long n = blocksamples;
+
+    		if (n > chunkend - pos)
+    			n = (long)(chunkend - pos);
+
+    		size_t bytes_read = reader.read(&raw[0], n * datatypesize);
+    		n = (long)(bytes_read / datatypesize);
+
+    		// The range was checked against the file size at setup
+    		if (n <= 0)
+    			return false;
+
+    		kernel(&raw[0], n, &flags[0]);
+
+    		long j = 0;
+
+    		while (j < n) {
+    			// Most of a healthy recording is clean, so step over 8 clean samples at a time
+    			if (j + 8 <= n) {
+    				uint64_t word;
+    				memcpy(&word, &flags[j], sizeof(word));
+
+    				if (word == 0) {
+    					j = j + 8;
+    					continue;
+    				}
+    			}
+
+    			if (flags[j]) {
+    				int64_t sample = pos + j;
+
+    				for (int t=0;t<3;t++) {
+    					if (!(flags[j] & types[t]))
+    						continue;
+
+    					int64_t gap = (types[t] == HEALTH_ZERO) ? 0 : healthmergegap;
+
+    					if (isopen[t] && (sample - open[t].end <= gap)) {
+    						open[t].end = sample + 1;
+    						open[t].count++;
+    					}
+    					else {
+    						if (isopen[t] && ((types[t] != HEALTH_ZERO) || (open[t].end - open[t].start >= healthmindropout) || (open[t].start == chunkstart)))
+    							found.push_back(open[t]);
+
+    						open[t].type = types[t];
+    						open[t].start = sample;
+    						open[t].end = sample + 1;
+    						open[t].count = 1;
+    						isopen[t] = true;
+    					}
+    				}
+    			}
+
+    			j++;
+    		}
+
+    		pos = pos + n;
+    	}
+
+    	for (int t=0;t<3;t++) {
+    		if (isopen[t] && ((types[t] != HEALTH_ZERO) || (open[t].end - open[t].start >= healthmindropout) ||
+    				(open[t].start == chunkstart) || (open[t].end == chunkend)))
+    			found.push_back(open[t]);
+    	}
+
+    	return true;
+    }
+
+    void sqlsource_impl::WriteHealthReport(std::ostream &out, int64_t nsamples, const std::vector<health_range> &found) {
+    	long startpos;
+    	long endpos;
+
+    	GetFileRange(startpos, endpos);
+
+    	int64_t counts[3] = { 0, 0, 0 };
+
+    	for (size_t r=0;r<found.size();r++) {
+    		if (found[r].type == HEALTH_CLIPPED)
+    			counts[0] = counts[0] + found[r].count;
+    		else if (found[r].type == HEALTH_ZERO)
+    			counts[1] = counts[1] + found[r].count;
+    		else
+    			counts[2] = counts[2] + found[r].count;
+    	}
+
+    	out << "{" << std::endl;
+    	out << "  \"source\": " << JsonQuoted(filename) << "," << std::endl;
+    	out << "  \"datatype\": \"" << DataTypeName(dataType) << "\"," << std::endl;
+    	out << "  \"sample_rate\": " << samplerate << "," << std::endl;
+    	out << "  \"start_sample\": " << startpos / datatypesize << "," << std::endl;
+    	out << "  \"samples\": " << nsamples << "," << std::endl;
+    	out << "  \"min_dropout\": " << healthmindropout << "," << std::endl;
+    	out << "  \"merge_gap\": " << healthmergegap << "," << std::endl;
+    	out << "  \"clipped_samples\": " << counts[0] << "," << std::endl;
+    	out << "  \"dropout_samples\": " << counts[1] << "," << std::endl;
+    	out << "  \"nonfinite_samples\": " << counts[2] << "," << std::endl;
+    	out << "  \"ranges\": [" << std::endl;
+
+    	for (size_t r=0;r<found.size();r++) {
+    		const char *type = (found[r].type == HEALTH_CLIPPED) ? "clipped" : ((found[r].type == HEALTH_ZERO) ? "dropout" : "nonfinite");
+
+    		out << "    {\"type\": \"" << type << "\", \"start_sample\": " << found[r].start << ", \"end_sample\": " << found[r].end
+    				<< ", \"start_time\": " << std::fixed << std::setprecision(9) << (double)found[r].start / (double)samplerate
+    				<< ", \"end_time\": " << (double)found[r].end / (double)samplerate
+    				<< ", \"count\": " << found[r].count << "}" << (r + 1 < found.size() ? "," : "") << std::endl;
+    	}
+
+    	out << "  ]" << std::endl;
+    	out << "}" << std::endl;
+    }
+
+    void sqlsource_impl::LoadMatchTemplate() {
+    	// The template is in the format grsql / the block outputs (ex: a preamble cut out with
+    	// SAVEAS), so complex or float.  Float is searched as complex with Q = 0.
+    	int itemsize = GetOutputItemSize();
+    	bool complexout = IsComplexOutput();
+    	bool floatout = (dataType == DATATYPE_FLOAT) || (selectAction == SELECT_I) || (selectAction == SELECT_Q);
+
+    	if (!complexout && !floatout) {
+    		ErrorOut() << "ERROR: WHERE MATCHES needs complex or float samples." << std::endl;
+    		ErrorExit();
+    	}
+
+    	long templatesize = GetFileSize(matchfile);
+    	long ntemplate = templatesize / itemsize;
+
+    	if ((ntemplate < 2) || (ntemplate > MATCHMAXTEMPLATE)) {
+    		ErrorOut() << "ERROR: The MATCHES template " << matchfile << " needs between 2 and " << MATCHMAXTEMPLATE << " " << (complexout ? "complex" : "float") << " samples." << std::endl;
+    		ErrorExit();
+    	}
+
+    	std::vector<unsigned char> raw(ntemplate * itemsize);
+    	ifstream infile(matchfile, std::ios::binary);
+
+    	if (!infile.is_open() || !infile.read((char *)&raw[0], raw.size())) {
+    		ErrorOut() << "ERROR: Unable to read the MATCHES template " << matchfile << std::endl;
+    		ErrorExit();
+    	}
+
+    	matchtemplate.resize(ntemplate);
+    	double energy = 0.0;
+
+    	for (long j=0;j<ntemplate;j++) {
+    		if (complexout)
+    			matchtemplate[j] = ((gr_complex *)&raw[0])[j];
+    		else
+    			matchtemplate[j] = gr_complex(((float *)&raw[0])[j], 0.0f);
+
+    		energy = energy + std::norm(matchtemplate[j]);
+    	}
+
+    	matchtemplatenorm = sqrt(energy);
+
+    	if (matchtemplatenorm <= 0.0) {
+    		ErrorOut() << "ERROR: The MATCHES template " << matchfile << " is all zeros." << std::endl;
+    		ErrorExit();
+    	}
+
+    	// Overlap-save: each FFT block gives fftsize - ntemplate + 1 new correlation outputs
+    	matchfftsize = (int)next_power_of_2(4 * ntemplate);
+
+    	if (matchfftsize < MATCHMINFFTSIZE)
+    		matchfftsize = MATCHMINFFTSIZE;
+
+    	gr::fft::fft_complex_fwd fwdfft(matchfftsize);
+    	gr_complex *fftin = fwdfft.get_inbuf();
+
+    	memset((void *)fftin, 0, matchfftsize * sizeof(gr_complex));
+
+    	for (long j=0;j<ntemplate;j++)
+    		fftin[j] = matchtemplate[j];
+
+    	fwdfft.execute();
+
+    	// conj for correlation, 1/N for the unnormalized inverse
+    	const gr_complex *fftout = fwdfft.get_outbuf();
+    	matchspectrum.resize(matchfftsize);
+
+    	for (int k=0;k<matchfftsize;k++)
+    		matchspectrum[k] = std::conj(fftout[k]) / (float)matchfftsize;
+
+    	std::cout << "INFO: MATCHES template is " << ntemplate << " samples (FFT size " << matchfftsize << ")." << std::endl;
+    }
+
+    bool sqlsource_impl::SearchMatches(std::vector< std::unique_ptr<file_reader> > &readers, std::string &failure) {
+    	// Split the selected range into chunks and correlate them in parallel, one worker per
+    	// reader.  Detections closer than a template length are merged to the strongest.
+    	// Returns false if the search was cancelled or failed (failure says why).
+    	long startpos;
+    	long endpos;
+
+    	GetFileRange(startpos, endpos);
+
+    	int64_t firstsample = startpos / datatypesize;
+    	int64_t lastsample = endpos / datatypesize;   // exclusive
+    	int64_t ntemplate = (int64_t)matchtemplate.size();
+    	int64_t npositions = lastsample - firstsample - ntemplate + 1;
+
+    	matches.clear();
+
+    	if (npositions <= 0) {
+    		std::cout << "INFO: The selected range is shorter than the MATCHES template." << std::endl;
+    		return true;
+    	}
+
+    	int nthreads = (int)readers.size();
+    	int64_t chunksize = npositions / (nthreads * MATCHCHUNKSPERTHREAD);
+    	int64_t minchunk = 4 * (int64_t)matchfftsize;
+
+    	if (chunksize < minchunk)
+    		chunksize = minchunk;
+
+    	int nchunks = (int)((npositions + chunksize - 1) / chunksize);
+
+    	if (nthreads > nchunks)
+    		nthreads = nchunks;
+
+    	std::vector< std::vector<match_hit> > chunkhits(nchunks);
+    	std::atomic<int> nextchunk(0);
+    	worker_failure failed;
+    	std::vector<std::thread> workers;
+
+    	for (int t=0;t<nthreads;t++) {
+    		file_reader *reader = readers[t].get();
+
+    		workers.push_back(std::thread([this, reader, &chunkhits, &nextchunk, &failed, nchunks, chunksize, firstsample, npositions, lastsample]() {
+    			try {
+    				// One pair of plans per worker, reused for every chunk it takes
+    				gr::fft::fft_complex_fwd fwdfft(matchfftsize);
+    				gr::fft::fft_complex_rev revfft(matchfftsize);
+    				int c;
+
+    				while (((c = nextchunk++) < nchunks) && !matchcancel.load()) {
+    					int64_t chunkstart = firstsample + (int64_t)c * chunksize;
+    					int64_t chunkend = chunkstart + chunksize;
+
+    					if (chunkend > firstsample + npositions)
+    						chunkend = firstsample + npositions;
+
+    					if (!SearchChunk(*reader, fwdfft, revfft, chunkstart, chunkend, lastsample, chunkhits[c])) {
+    						failed.set("Unable to read " + filename + " around sample " + std::to_string(chunkstart) + ".  Was it truncated?");
+    						matchcancel = true;
+    					}
+    				}
+    			}
+    			catch (std::exception &e) {
+    				failed.set(std::string("MATCHES search: ") + e.what());
+    				matchcancel = true;
+    			}
+    		}));
+    	}
+
+    	for (size_t t=0;t<workers.size();t++)
+    		workers[t].join();
+
+    	if (failed.failed.load()) {
+    		failure = failed.message;
+    		return false;
+    	}
+
+    	if (matchcancel.load())
+    		return false;
+
+    	// Chunks are in order, so only hits either side of a chunk boundary can need merging
+    	for (int c=0;c<nchunks;c++) {
+    		for (size_t h=0;h<chunkhits[c].size();h++) {
+    			const match_hit &hit = chunkhits[c][h];
+
+    			if ((matches.size() > 0) && (hit.sample - matches.back().sample < ntemplate)) {
+    				if (hit.score > matches.back().score)
+    					matches.back() = hit;
+    			}
+    			else {
+    				matches.push_back(hit);
+    			}
+    		}
+    	}
+
+    	std::cout << "INFO: MATCHES found " << matches.size() << " detection(s) at THRESHOLD " << matchthreshold << " in " << npositions << " samples (" << nthreads << " thread(s))." << std::endl;
+
+    	return true;
+    }
+
+    void sqlsource_impl::StartMatchSearch() {
+    	// Called from start() / work() with the scheduler running, so failures are logged and
+    	// work() ends the stream (matchcancel) rather than exiting.
+    	if (matchready.load() || matchfailed.load() || matchsearch.joinable())
+    		return;
+
+    	if (!OpenWorkerReaders(WorkerThreads(), matchreaders)) {
+    		std::cout << "ERROR: Unable to open input file " << filename << ".  Nothing will be played." << std::endl;
+    		matchfailed = true;
+    		matchcancel = true;
+    		return;
+    	}
+
+    	matchcancel = false;
+
+    	matchsearch = std::thread([this]() {
+    		std::string failure;
+
+    		if (SearchMatches(matchreaders, failure)) {
+    			BuildMatchWindows();
+    			matchready = true;
+    		}
+    		else if (failure.length() > 0) {
+    			std::cout << "ERROR: " << failure << "  Nothing will be played." << std::endl;
+    			matchfailed = true;
+    			matchcancel = true;
+    		}
+
+    		matchreaders.clear();
+    	});
+    }
+
+    bool sqlsource_impl::SearchChunk(file_reader &reader, gr::fft::fft_complex_fwd &fwdfft, gr::fft::fft_complex_rev &revfft, int64_t chunkstart, int64_t chunkend, int64_t rangeend, std::vector<match_hit> &hits) {
+    	// Correlation for template start positions [chunkstart, chunkend).  Reads run up to
+    	// rangeend so the last positions see a full template's worth of samples.  Runs on a
+    	// worker thread: returns false if the file can't be read instead of exiting.
+    	int fftsize = matchfftsize;
+    	int ntemplate = (int)matchtemplate.size();
+    	int hop = fftsize - ntemplate + 1;
+
+    	std::vector<gr_complex> block(fftsize);    // time domain samples [blockstart, blockstart + fftsize)
+    	const gr_complex *corr = revfft.get_outbuf();
+    	std::vector<unsigned char> raw;
+    	std::vector<unsigned char> converted;
+    	std::vector<double> cumenergy(fftsize + 1);
+
+    	int64_t blockstart = chunkstart;
+    	int64_t readpos = chunkstart;
+    	int have = 0;
+    	bool hitopen = false;
+    	match_hit best;
+
+    	if (!reader.seek(chunkstart * datatypesize))
+    		return false;
+
+    	while ((blockstart < chunkend) && !matchcancel.load()) {
+    		// Top the block up from the file (converted to the output format, then to complex)
+    		int64_t wantend = blockstart + fftsize;
+
+    		if (wantend > rangeend)
+    			wantend = rangeend;
+
+    		int nread = (int)(wantend - readpos);
+
+    		if (nread > 0) {
+    			nread = (int)ReadSamples(reader, nread, raw, converted, &block[have]);
+
+    			// The range was checked against the file size at setup
+    			if (nread <= 0)
+    				return false;
+
+    			have = have + nread;
+    			readpos = readpos + nread;
+    		}
+
+    		if (have < ntemplate)
+    			break;
+
+    		for (int j=have;j<fftsize;j++)
+    			block[j] = gr_complex(0.0f, 0.0f);
+
+    		// corr[n] = sum_m block[n + m] * conj(template[m]), valid for n <= fftsize - ntemplate
+    		memcpy(fwdfft.get_inbuf(), &block[0], fftsize * sizeof(gr_complex));
+    		fwdfft.execute();
+    		volk_32fc_x2_multiply_32fc(revfft.get_inbuf(), fwdfft.get_outbuf(), &matchspectrum[0], fftsize);
+    		revfft.execute();
+
+    		// Normalize by the energy under the template so THRESHOLD doesn't depend on gain
+    		cumenergy[0] = 0.0;
+
+    		for (int j=0;j<have;j++)
+    			cumenergy[j + 1] = cumenergy[j] + (double)std::norm(block[j]);
+
+    		int npos = have - ntemplate + 1;
+
+    		if (npos > hop)
+    			npos = hop;
+
+    		if (blockstart + npos > chunkend)
+    			npos = (int)(chunkend - blockstart);
+
+    		for (int n=0;n<npos;n++) {
+    			double energy = cumenergy[n + ntemplate] - cumenergy[n];
+
+    			if (energy <= 0.0)
+    				continue;
+
+    			double score = (double)std::abs(corr[n]) / (matchtemplatenorm * sqrt(energy));
+
+    			if (score < matchthreshold)
+    				continue;
+
+    			int64_t sample = blockstart + n;
+
+    			// Keep the strongest of any detections within a template length of each other
+    			if (hitopen && (sample - best.sample < ntemplate)) {
+    				if (score > best.score) {
+    					best.sample = sample;
+    					best.score = score;
+    				}
+    			}
+    			else {
+    				if (hitopen)
+    					hits.push_back(best);
+
+    				best.sample = sample;
+    				best.score = score;
+    				best.outsample = 0;
+    				hitopen = true;
+    			}
+    		}
+
+    		// Slide: keep the last ntemplate - 1 samples for the next block
+    		int keep = have - hop;
+
+    		if (keep <= 0)
+    			break;
+
+    		memmove(&block[0], &block[hop], keep * sizeof(gr_complex));
+    		have = keep;
+    		blockstart = blockstart + hop;
+    	}
+
+    	if (hitopen)
+    		hits.push_back(best);
+
+    	return true;
+    }
+
+    void sqlsource_impl::BuildMatchWindows() {
+    	// WINDOW before,after around each detection (template included).  Overlapping windows
+    	// are merged so no sample is output twice.
+    	long startpos;
+    	long endpos;
+
+    	GetFileRange(startpos, endpos);
+
+    	int64_t firstsample = startpos / datatypesize;
+    	int64_t lastsample = endpos / datatypesize;
+    	int64_t ntemplate = (int64_t)matchtemplate.size();
+    	int64_t outsample = 0;
+
+    	matchwindows.clear();
+
+    	for (size_t h=0;h<matches.size();h++) {
+    		int64_t start = matches[h].sample - matchbefore;
+    		int64_t end = matches[h].sample + ntemplate + matchafter;
+
+    		if (start < firstsample)
+    			start = firstsample;
+
+    		if (end > lastsample)
+    			end = lastsample;
+
+    		if ((matchwindows.size() > 0) && (start <= matchwindows.back().end)) {
+    			outsample = outsample + (end - matchwindows.back().end);
+    			matchwindows.back().end = end;
+    		}
+    		else {
+    			match_window window;
+    			window.start = start;
+    			window.end = end;
+    			window.outsample = outsample;
+    			matchwindows.push_back(window);
+    			outsample = outsample + (end - start);
+    		}
+
+    		matches[h].outsample = matchwindows.back().outsample + (matches[h].sample - matchwindows.back().start);
+    	}
+    }
+
+    void sqlsource_impl::SeekMatchWindow(size_t w) {
+    	curmatchwindow = w;
+    	curfileposition = (long)(matchwindows[w].start * datatypesize);
+    	endfileposition = (long)(matchwindows[w].end * datatypesize);
+    	pInputFile->seek(curfileposition);
+    }
+
+    int sqlsource_impl::ReadMatchWindows(int noutput_items, void *output) {
+    	// Block output for WHERE MATCHES / ANNOTATION: the windows back to back, with a "match"
+    	// tag (source sample, score) on the first sample of each detection, or an "annotation"
+    	// tag (label, source sample) on the first sample of each annotation.
+    	int produced = 0;
+    	int itemsize = GetOutputItemSize();
+    	unsigned char *out = (unsigned char *)output;
+    	uint64_t written = nitems_written(0);
+
+    	while ((produced < noutput_items) && (curmatchwindow < matchwindows.size())) {
+    		int n = ReadItems(noutput_items - produced, (void *)&out[produced * itemsize]);
+
+    		if (n <= 0) {
+    			if (curmatchwindow + 1 < matchwindows.size())
+    				SeekMatchWindow(curmatchwindow + 1);
+    			else
+    				curmatchwindow = matchwindows.size();
+
+    			continue;
+    		}
+
+    		produced = produced + n;
+    	}
+
+    	while ((nextmatchtag < matches.size()) && ((uint64_t)matches[nextmatchtag].outsample < written + produced)) {
+    		add_item_tag(0, (uint64_t)matches[nextmatchtag].outsample, pmt::string_to_symbol("match"),
+    				pmt::make_tuple(pmt::from_uint64((uint64_t)matches[nextmatchtag].sample), pmt::from_double(matches[nextmatchtag].score)));
+    		nextmatchtag++;
+    	}
+
+    	while ((nextannotationtag < annotations.size()) && ((uint64_t)annotations[nextannotationtag].outsample < written + produced)) {
+    		add_item_tag(0, (uint64_t)annotations[nextannotationtag].outsample, pmt::string_to_symbol("annotation"),
+    				pmt::make_tuple(pmt::string_to_symbol(annotations[nextannotationtag].label), pmt::from_uint64((uint64_t)annotations[nextannotationtag].start)));
+    		nextannotationtag++;
+    	}
+
+    	return produced;
+    }
+
+    int sqlsource_impl::SaveMatches() {
+    	std::vector< std::unique_ptr<file_reader> > readers;
+    	std::string failure;
+
+    	if (!OpenWorkerReaders(WorkerThreads(), readers)) {
+    		ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    		ErrorExit();
+    	}
+
+    	if (!SearchMatches(readers, failure)) {
+    		ErrorOut() << "ERROR: " << failure << std::endl;
+    		ErrorExit();
+    	}
+
+    	readers.clear();
+    	BuildMatchWindows();
+
+    	if (!hasOutputFile) {
+    		// Detections only
+    		WriteMatchManifest(std::cout);
+    		return 0;
+    	}
+
+    	file_reader reader(filename, iopolicy, readahead);
+
+    	if (!reader.is_open()) {
+    		ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    		ErrorExit();
+    	}
+
+		file_writer writer(outputfile, iopolicy, readahead);
+
+		if (!writer.is_open()) {
+			ErrorOut() << "ERROR: Unable to open output file " << outputfile << std::endl;
+			ErrorExit();
+		}
+
+		for (size_t w=0;w<matchwindows.size();w++)
+			CopyRange(&reader, &writer, (long)(matchwindows[w].start * datatypesize), (long)(matchwindows[w].end * datatypesize));
+
+		writer.close();
+
+    	std::string base;
+    	std::string ext;
+    	SplitOutputFileName(base, ext);
+
+		std::string manifestfile = base + ".matches.json";
+		ofstream manifest(manifestfile);
+
+		if (!manifest.is_open()) {
+			ErrorOut() << "ERROR: Unable to write to " << manifestfile << std::endl;
+			ErrorExit();
+		}
+
+		WriteMatchManifest(manifest);
+		manifest.close();
+
+		std::cout << "INFO: Wrote " << matchwindows.size() << " window(s) to " << outputfile << ".  Manifest: " << manifestfile << std::endl;
+
+    	return 0;
+    }
+
+    void sqlsource_impl::WriteMatchManifest(std::ostream &out) {
+    	out << "{" << std::endl;
+    	out << "  \"source\": " << JsonQuoted(filename) << "," << std::endl;
+    	out << "  \"template\": " << JsonQuoted(matchfile) << "," << std::endl;
+    	out << "  \"sample_rate\": " << samplerate << "," << std::endl;
+    	out << "  \"template_samples\": " << matchtemplate.size() << "," << std::endl;
+    	out << "  \"threshold\": " << matchthreshold << "," << std::endl;
+    	out << "  \"matches\": [" << std::endl;
+
+    	for (size_t h=0;h<matches.size();h++) {
+    		out << "    {\"sample\": " << matches[h].sample << ", \"time\": " << std::fixed << std::setprecision(9) << (double)matches[h].sample / (double)samplerate
+    				<< ", \"score\": " << std::setprecision(4) << matches[h].score << ", \"output_sample\": " << matches[h].outsample
+    				<< "}" << (h + 1 < matches.size() ? "," : "") << std::endl;
+    	}
+
+    	out << "  ]," << std::endl;
+    	out << "  \"windows\": [" << std::endl;
+
+    	for (size_t w=0;w<matchwindows.size();w++) {
+    		out << "    {\"start_sample\": " << matchwindows[w].start << ", \"end_sample\": " << matchwindows[w].end
+    				<< ", \"output_sample\": " << matchwindows[w].outsample << "}" << (w + 1 < matchwindows.size() ? "," : "") << std::endl;
+    	}
+
+    	out << "  ]" << std::endl;
+    	out << "}" << std::endl;
+    }
+
+    bool sqlsource_impl::ReadSidecarAnnotations(std::string datafile, std::vector<sigmf_annotation> &found) {
+    	sidecar_info info;
+
+    	if (!LoadSidecar(datafile, true, info))
+    		return false;
+
+    	found.insert(found.end(), info.annotations.begin(), info.annotations.end());
+
+    	return true;
+    }
+
+    // Sidecar fields are picked out by hand rather than with std::regex: libstdc++'s regex
+    // recurses once per character a repeat matches, so one long string (ex: a label tens of KB
+    // long) overflows the stack.  No JSON library dependency either way.
+
+    // Position of the value after "key": in text, or npos
+    static size_t JsonFindValue(const std::string &text, const std::string &key) {
+    	std::string quoted = "\"" + key + "\"";
+    	size_t pos = text.find(quoted);
+
+    	while (pos != std::string::npos) {
+    		size_t p = pos + quoted.length();
+
+    		while ((p < text.length()) && isspace((unsigned char)text[p]))
+    			p++;
+
+    		if ((p < text.length()) && (text[p] == ':')) {
+    			p++;
+
+    			while ((p < text.length()) && isspace((unsigned char)text[p]))
+    				p++;
+
+    			return p;
+    		}
+
+    		pos = text.find(quoted, pos + 1);
+    	}
+
+    	return std::string::npos;
+    }
+
+    static void AppendUtf8(std::string &out, unsigned long cp) {
+    	if (cp < 0x80) {
+    		out += (char)cp;
+    	}
+    	else if (cp < 0x800) {
+    		out += (char)(0xC0 | (cp >> 6));
+    		out += (char)(0x80 | (cp & 0x3F));
+    	}
+    	else if (cp < 0x10000) {
+    		out += (char)(0xE0 | (cp >> 12));
+    		out += (char)(0x80 | ((cp >> 6) & 0x3F));
+    		out += (char)(0x80 | (cp & 0x3F));
+    	}
+    	else {
+    		out += (char)(0xF0 | (cp >> 18));
+    		out += (char)(0x80 | ((cp >> 12) & 0x3F));
+    		out += (char)(0x80 | ((cp >> 6) & 0x3F));
+    		out += (char)(0x80 | (cp & 0x3F));
+    	}
+    }
+
+    // "key": "<string>", unescaped.  False if the key is missing or its value isn't a string.
+    static bool JsonStringField(const std::string &text, const std::string &key, std::string &value) {
+    	size_t pos = JsonFindValue(text, key);
+
+    	if ((pos == std::string::npos) || (pos >= text.length()) || (text[pos] != '"'))
+    		return false;
+
+    	value = "";
+
+    	for (pos++;pos < text.length();pos++) {
+    		char c = text[pos];
+
+    		if (c == '"')
+    			return true;
+
+    		if ((c != '\\') || (pos + 1 >= text.length())) {
+    			value += c;
+    			continue;
+    		}
+
+    		pos++;
+
+    		switch (text[pos]) {
+    		case 'b': value += '\b'; break;
+    		case 'f': value += '\f'; break;
+    		case 'n': value += '\n'; break;
+    		case 'r': value += '\r'; break;
+    		case 't': value += '\t'; break;
+    		case 'u':
+    			if (pos + 4 < text.length()) {
+    				unsigned long cp = strtoul(text.substr(pos + 1, 4).c_str(), NULL, 16);
+    				pos = pos + 4;
+
+    				// Surrogate pair
+    				if ((cp >= 0xD800) && (cp < 0xDC00) && (pos + 6 < text.length()) && (text[pos + 1] == '\\') && (text[pos + 2] == 'u')) {
+    					unsigned long low = strtoul(text.substr(pos + 3, 4).c_str(), NULL, 16);
+
+    					if ((low >= 0xDC00) && (low < 0xE000)) {
+    						cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+    						pos = pos + 6;
+    					}
+    				}
+
+    				AppendUtf8(value, cp);
+    			}
+    		break;
+    		default:
+    			// \" \\ \/
+    			value += text[pos];
+    		break;
+    		}
+    	}
+
+    	return false;  // unterminated
+    }
+
+    // "key": <number> as its text.  False if the key is missing or there's no number there.
+    static bool JsonNumberField(const std::string &text, const std::string &key, std::string &value) {
+    	size_t pos = JsonFindValue(text, key);
+
+    	if (pos == std::string::npos)
+    		return false;
+
+    	size_t end = text.find_first_not_of("0123456789.eE+-", pos);
+
+    	if (end == std::string::npos)
+    		end = text.length();
+
+    	value = text.substr(pos, end - pos);
+
+    	return value.length() > 0;
+    }
+
+    void sqlsource_impl::ParseSidecarAnnotations(const std::string &text, std::vector<sigmf_annotation> &found) {
+    	// Each object in the "annotations" array: walk the array to split out the objects, then
+    	// pick the core fields out of each.
+		size_t pos = JsonFindValue(text, "annotations");
+
+		if ((pos == std::string::npos) || (pos >= text.length()) || (text[pos] != '['))
+			return;
+
+		pos++;
+		size_t objstart = 0;
+		int depth = 0;
+		bool instring = false;
+
+		for (;pos < text.length();pos++) {
+			char c = text[pos];
+
+			if (instring) {
+				if (c == '\\')
+					pos++;
+				else if (c == '"')
+					instring = false;
+
+				continue;
+			}
+
+			if (c == '"') {
+				instring = true;
+			}
+			else if ((c == '{') || (c == '[')) {
+				if ((depth == 0) && (c == '{'))
+					objstart = pos;
+
+				depth++;
+			}
+			else if ((c == '}') || (c == ']')) {
+				if (depth == 0)
+					break;  // end of the annotations array
+
+				depth--;
+
+				if ((depth == 0) && (c == '}')) {
+					std::string obj = text.substr(objstart, pos - objstart + 1);
+					sigmf_annotation annotation;
+					std::string sstart;
+					std::string scount;
+
+					if ( !JsonNumberField(obj, "core:sample_start", sstart) )
+						continue;
+
+					annotation.start = strtoll(sstart.c_str(), NULL, 10);
+					annotation.count = -1;
+					annotation.outsample = 0;
+					annotation.window = 0;
+
+					if ( JsonNumberField(obj, "core:sample_count", scount) )
+						annotation.count = strtoll(scount.c_str(), NULL, 10);
+
+					JsonStringField(obj, "core:label", annotation.label);
+
+					found.push_back(annotation);
+				}
+			}
+		}
+    }
+
+    void sqlsource_impl::LoadAnnotations() {
+    	std::vector<sigmf_annotation> all;
+
+    	if (!ReadSidecarAnnotations(filename, all)) {
+    		ErrorOut() << "ERROR: WHERE ANNOTATION needs a SigMF sidecar (" << SidecarFileName(filename) << ")." << std::endl;
+    		ErrorExit();
+    	}
+
+    	annotations.clear();
+
+    	for (size_t a=0;a<all.size();a++) {
+    		if (all[a].label == annotationlabel)
+    			annotations.push_back(all[a]);
+    	}
+
+    	// SigMF asks for sorted annotations but doesn't guarantee it
+    	std::stable_sort(annotations.begin(), annotations.end(), [](const sigmf_annotation &a, const sigmf_annotation &b) {
+    		return a.start < b.start;
+    	});
+
+    	std::cout << "INFO: " << annotations.size() << " of " << all.size() << " annotation(s) in " << SidecarFileName(filename) << " are labeled '" << annotationlabel << "'" << std::endl;
+    }
+
+    void sqlsource_impl::BuildAnnotationWindows() {
+    	// PAD either side of each annotation, clipped to the selected range.  Overlapping windows
+    	// are merged (no sample output twice) unless each annotation gets its own file.
+    	long startpos;
+    	long endpos;
+
+    	GetFileRange(startpos, endpos);
+
+    	int64_t firstsample = startpos / datatypesize;
+    	int64_t lastsample = endpos / datatypesize;
+    	int64_t outsample = 0;
+    	std::vector<sigmf_annotation> inrange;
+
+    	matchwindows.clear();
+
+    	for (size_t a=0;a<annotations.size();a++) {
+    		int64_t annotationend = (annotations[a].count < 0) ? lastsample : annotations[a].start + annotations[a].count;
+    		int64_t start = annotations[a].start - annotationpad;
+    		int64_t end = annotationend + annotationpad;
+
+    		if (start < firstsample)
+    			start = firstsample;
+
+    		if (end > lastsample)
+    			end = lastsample;
+
+    		if (end <= start)
+    			continue;
+
+    		if (!annotationsplit && (matchwindows.size() > 0) && (start <= matchwindows.back().end)) {
+    			if (end > matchwindows.back().end) {
+    				outsample = outsample + (end - matchwindows.back().end);
+    				matchwindows.back().end = end;
+    			}
+    		}
+    		else {
+    			match_window window;
+    			window.start = start;
+    			window.end = end;
+    			window.outsample = annotationsplit ? 0 : outsample;
+    			matchwindows.push_back(window);
+    			outsample = outsample + (end - start);
+    		}
+
+    		sigmf_annotation annotation = annotations[a];
+    		int64_t offset = annotation.start - matchwindows.back().start;
+    		annotation.outsample = matchwindows.back().outsample + ((offset > 0) ? offset : 0);
+    		annotation.window = matchwindows.size() - 1;
+    		inrange.push_back(annotation);
+    	}
+
+    	annotations = inrange;
+    }
+
+    int sqlsource_impl::SaveAnnotations() {
+    	BuildAnnotationWindows();
+
+    	std::vector<std::string> outfiles;
+
+    	if (!hasOutputFile) {
+    		// Just the plan
+    		WriteAnnotationManifest(std::cout, outfiles);
+    		return 0;
+    	}
+
+    	std::string base;
+    	std::string ext;
+    	SplitOutputFileName(base, ext);
+
+    	// One ordered pass through the file, whichever way it's written out
+    	file_reader reader(filename, iopolicy, readahead);
+
+    	if (!reader.is_open()) {
+    		ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    		ErrorExit();
+    	}
+
+    	file_writer *writer = NULL;
+
+    	for (size_t w=0;w<matchwindows.size();w++) {
+    		if (!writer || annotationsplit) {
+    			std::string outfile = annotationsplit ? base + "_" + std::to_string(w) + ext : outputfile;
+
+    			if (writer) {
+    				writer->close();
+    				delete writer;
+    			}
+
+    			writer = new file_writer(outfile, iopolicy, readahead);
+
+    			if (!writer->is_open()) {
+    				ErrorOut() << "ERROR: Unable to open output file " << outfile << std::endl;
+    				ErrorExit();
+    			}
+
+    			outfiles.push_back(outfile);
+    		}
+
+    		CopyRange(&reader, writer, (long)(matchwindows[w].start * datatypesize), (long)(matchwindows[w].end * datatypesize));
+    	}
+
+    	if (!writer) {
+    		// Nothing matched: still leave an (empty) output so scripts find what they expect
+    		writer = new file_writer(outputfile, iopolicy, readahead);
+    		outfiles.push_back(outputfile);
+    	}
+
+    	writer->close();
+    	delete writer;
+
+		std::string manifestfile = base + ".annotations.json";
+		ofstream manifest(manifestfile);
+
+		if (!manifest.is_open()) {
+			ErrorOut() << "ERROR: Unable to write to " << manifestfile << std::endl;
+			ErrorExit();
+		}
+
+		WriteAnnotationManifest(manifest, outfiles);
+		manifest.close();
+
+		std::cout << "INFO: Wrote " << annotations.size() << " annotation(s) in " << matchwindows.size() << " window(s) to "
+				<< (annotationsplit ? base + "_<n>" + ext : outputfile) << ".  Manifest: " << manifestfile << std::endl;
+
+    	return 0;
+    }
+
+    void sqlsource_impl::WriteAnnotationManifest(std::ostream &out, const std::vector<std::string> &outfiles) {
+    	out << "{" << std::endl;
+    	out << "  \"source\": " << JsonQuoted(filename) << "," << std::endl;
+    	out << "  \"label\": " << JsonQuoted(annotationlabel) << "," << std::endl;
+    	out << "  \"sample_rate\": " << samplerate << "," << std::endl;
+    	out << "  \"pad_samples\": " << annotationpad << "," << std::endl;
+    	out << "  \"annotations\": [" << std::endl;
+
+    	for (size_t a=0;a<annotations.size();a++) {
+    		out << "    {\"sample_start\": " << annotations[a].start << ", \"sample_count\": ";
+
+    		if (annotations[a].count < 0)
+    			out << "null";
+    		else
+    			out << annotations[a].count;
+
+    		out << ", \"time\": " << std::fixed << std::setprecision(9) << (double)annotations[a].start / (double)samplerate;
+
+    		if (annotationsplit && (annotations[a].window < outfiles.size()))
+    			out << ", \"output_file\": " << JsonQuoted(outfiles[annotations[a].window]);
+
+    		out << ", \"output_sample\": " << annotations[a].outsample << "}" << (a + 1 < annotations.size() ? "," : "") << std::endl;
+    	}
+
+    	out << "  ]," << std::endl;
+    	out << "  \"windows\": [" << std::endl;
+
+    	for (size_t w=0;w<matchwindows.size();w++) {
+    		out << "    {\"start_sample\": " << matchwindows[w].start << ", \"end_sample\": " << matchwindows[w].end
+    				<< ", \"output_sample\": " << matchwindows[w].outsample << "}" << (w + 1 < matchwindows.size() ? "," : "") << std::endl;
+    	}
+
+    	out << "  ]" << std::endl;
+    	out << "}" << std::endl;
+    }
+
+    void sqlsource_impl::SetupJoin() {
+    	// The joined recording gets its own instance (its own reader, conversion and
+    	// filter) that work() / SaveJoined() pull from in lockstep with this one.
+    	std::smatch match;
+    	std::regex rgxjoindatatype(" ASDATATYPE",std::regex_constants::icase);
+    	std::regex rgxjoinsamplerate(" SAMPLERATE",std::regex_constants::icase);
+
+    	std::string joinsql = "SELECT ";
+
+    	if (selectAction == SELECT_I)
+    		joinsql += "I";
+    	else if (selectAction == SELECT_Q)
+    		joinsql += "Q";
+    	else
+    		joinsql += "*";
+
+    	joinsql += " FROM '" + joinfile + "'" + joinoptions;
+
+    	// Anything not given for the joined file (or in its sidecar) is assumed to match this one
+    	int sidecartype = DATATYPE_UNKNOWN;
+    	long sidecarrate = 0;
+    	ReadSidecar(joinfile, sidecartype, sidecarrate);
+
+    	if (!std::regex_search(joinoptions, match, rgxjoindatatype) && (sidecartype == DATATYPE_UNKNOWN))
+    		joinsql += " ASDATATYPE " + DataTypeName(dataType);
+
+    	if (!std::regex_search(joinoptions, match, rgxjoinsamplerate) && (sidecarrate <= 0))
+    		joinsql += " SAMPLERATE " + std::to_string(samplerate);
+
+    	// The real start is set once this side's start is known (OpenJoinedFile)
+    	joinsql += " STARTATSAMPLE 0";
+
+    	try {
+    		joined.reset(new sqlsource_impl(joinsql.c_str(), DATATYPE_QUERY));
+    	}
+    	catch (std::exception &e) {
+    		ErrorOut() << "ERROR: JOIN '" << joinfile << "': " << e.what() << std::endl;
+    		ErrorExit();
+    	}
+
+    	// From here on the joined side fails the same way this one does
+    	joined->throwerrors = throwerrors;
+    	joined->iopolicy = iopolicy;
+    	joined->readahead = readahead;
+
+    	if (joined->samplerate == samplerate) {
+    		// Same rate: run the same filter so both outputs stay sample for sample
+    		joined->resampletorate = resampletorate;
+    		joined->decimation = decimation;
+    		joined->resampletaps = resampletaps;
+    		joined->hascenter = hascenter;
+    		joined->centerfreq = centerfreq;
+    		joined->bandwidth = bandwidth;
+    	}
+    	else {
+    		// Different rates: resample the joined recording to this side's output rate
+    		if (hascenter) {
+    			ErrorOut() << "ERROR: JOIN of recordings with different sample rates can't be combined with CENTER.  Please RESAMPLE one of them first." << std::endl;
+    			ErrorExit();
+    		}
+
+    		long joinrate = llround(outputrate);
+
+    		if (fabs(outputrate - (double)joinrate) > 1e-6) {
+    			ErrorOut() << "ERROR: JOIN can't resample " << joinfile << " to a fractional rate (" << std::fixed << std::setprecision(3) << outputrate << " SPS).  Please use RESAMPLE TO." << std::endl;
+    			ErrorExit();
+    		}
+
+    		joined->resampletorate = joinrate;
+    		joined->resampletaps = resampletaps;
+    		std::cout << "INFO: JOIN resampling " << joinfile << " from " << joined->samplerate << " to " << joinrate << " SPS." << std::endl;
+    	}
+
+    	if ((joined->resampletorate > 0) || (joined->decimation > 0) || joined->hascenter) {
+    		joined->SetupFilters();
+    	}
+
+    	if ((joined->IsComplexOutput() != IsComplexOutput()) || (joined->GetOutputItemSize() != GetOutputItemSize())) {
+    		ErrorOut() << "ERROR: JOINed recordings need to come out as the same type.  " << filename << " outputs " << GetOutputItemSize() <<
+    				"-byte samples and " << joinfile << " outputs " << joined->GetOutputItemSize() << "-byte samples." << std::endl;
+    		ErrorExit();
+    	}
+    }
+
+    void sqlsource_impl::OpenJoinedFile() {
+    	// Called right after OpenInputFile().  Sample s of this recording (at time s / samplerate)
+    	// pairs with the joined recording's sample at that time + OFFSET, in its own rate.
+    	int64_t joinrate = (int64_t)joined->samplerate;
+    	int64_t offsetsamples = joined->TimeToSample(joinoffset);
+
+    	if (joinoffsetnegative)
+    		offsetsamples = -offsetsamples;
+
+    	int64_t ourstart = curfileposition / datatypesize;
+    	int64_t joinstart = (int64_t)(((__int128)ourstart * joinrate + samplerate / 2) / samplerate) + offsetsamples;
+
+    	if (joinstart < 0) {
+    		// The joined recording starts later.  Skip ahead on this side until both have samples.
+    		int64_t skip = (int64_t)(((__int128)(-joinstart) * samplerate + joinrate - 1) / joinrate);
+
+    		if (vlen > 1)
+    			skip = ((skip + vlen - 1) / vlen) * vlen;
+
+    		if (curfileposition + skip * datatypesize >= endfileposition) {
+    			ErrorOut() << "ERROR: With the JOIN OFFSET the two recordings don't overlap in the selected range." << std::endl;
+    			ErrorExit();
+    		}
+
+    		std::cout << "INFO: JOIN skipping the first " << skip << " samples of " << filename << " (before " << joinfile << " starts)." << std::endl;
+    		curfileposition = curfileposition + skip * datatypesize;
+    		pInputFile->seek(curfileposition);
+    		ourstart = ourstart + skip;
+    		joinstart = (int64_t)(((__int128)ourstart * joinrate + samplerate / 2) / samplerate) + offsetsamples;
+    	}
+
+    	if (joinstart >= joined->numdatapoints) {
+    		ErrorOut() << "ERROR: With the JOIN OFFSET the start is past the end of " << joinfile << std::endl;
+    		ErrorExit();
+    	}
+
+    	joined->startsample = joinstart;
+    	joined->endsample = -1;
+    	joined->OpenInputFile();
+
+    	std::cout << "INFO: JOIN sample " << ourstart << " of " << filename << " lines up with sample " << joinstart << " of " << joinfile << std::endl;
+    }
+
+    int sqlsource_impl::SaveJoined() {
+    	// Paired (out_0 / out_1) or INTERLEAVED (one vector from each in turn) output in one pass
+    	std::vector<file_writer *> outfiles;
+
+    	if (joininterleave) {
+    		outfiles.push_back(new file_writer(outputfile, iopolicy, readahead));
+    	}
+    	else {
+        	std::string base;
+        	std::string ext;
+        	SplitOutputFileName(base, ext);
+
+        	for (int f=0;f<2;f++)
+        		outfiles.push_back(new file_writer(base + "_" + std::to_string(f) + ext, iopolicy, readahead));
+    	}
+
+    	for (size_t f=0;f<outfiles.size();f++) {
+    		if (!outfiles[f]->is_open()) {
+    			ErrorOut() << "ERROR: Unable to open output file for " << outputfile << std::endl;
+    			ErrorExit();
+    		}
+    	}
+
+		OpenInputFile();
+		OpenJoinedFile();
+
+		long vectorsize = (long)GetOutputItemSize() * (long)vlen;
+		long nvectors = FILEREADBLOCKSIZE / vectorsize;
+
+		if (nvectors < 1)
+			nvectors = 1;
+
+		std::vector<unsigned char> ours(nvectors * vectorsize);
+		std::vector<unsigned char> theirs(nvectors * vectorsize);
+		std::vector<unsigned char> interleaved;
+
+		if (joininterleave)
+			interleaved.resize(2 * nvectors * vectorsize);
+
+		long total = 0;
+		int n;
+
+		while ((n = ReadVectors((int)nvectors, (void *)&ours[0])) > 0) {
+			// The joined instance is vlen 1 so the framing always follows this side
+			int m = joined->ReadVectors(n * vlen, (void *)&theirs[0]) / vlen;
+
+			if (m < n)
+				n = m;
+
+			if (n <= 0)
+				break;
+
+			if (joininterleave) {
+				for (int v=0;v<n;v++) {
+					memcpy(&interleaved[2 * v * vectorsize], &ours[v * vectorsize], vectorsize);
+					memcpy(&interleaved[(2 * v + 1) * vectorsize], &theirs[v * vectorsize], vectorsize);
+				}
+
+				outfiles[0]->write(&interleaved[0], vectorsize, 2 * n);
+			}
+			else {
+				outfiles[0]->write(&ours[0], vectorsize, n);
+				outfiles[1]->write(&theirs[0], vectorsize, n);
+			}
+
+			total = total + n;
+
+			if (m < (int)nvectors)
+				break;
+		}
+
+		std::cout << "INFO: JOIN wrote " << total * vlen << " sample pairs." << std::endl;
+
+		delete pInputFile;
+		pInputFile = NULL;
+		joined->stop();
+
+		for (size_t f=0;f<outfiles.size();f++)
+			delete outfiles[f];
+
+		return 0;
+    }
+
+    int sqlsource_impl::SaveShards() {
+    	// Split the selected range into shardcount pieces on whole sample (and VLEN frame)
+    	// boundaries.  Each shard after the first also carries OVERLAP samples from the end
+    	// of the previous one so filters / demods can settle before the part the shard owns.
+    	long startpos;
+    	long endpos;
+
+    	GetFileRange(startpos, endpos);
+
+    	int64_t firstsample = startpos / datatypesize;
+    	int64_t framesize = vlen;
+    	int64_t nframes = ((endpos - startpos) / datatypesize) / framesize;
+
+    	if (nframes < shardcount) {
+    		ErrorOut() << "ERROR: The selected range only has " << nframes * framesize << " samples, not enough for " << shardcount << " shards." << std::endl;
+    		ErrorExit();
+    	}
+
+    	int64_t overlap = ((shardoverlap + framesize - 1) / framesize) * framesize;
+
+    	std::string base;
+    	std::string ext;
+    	SplitOutputFileName(base, ext);
+
+    	std::vector<shard_range> shards(shardcount);
+
+    	for (int n=0;n<shardcount;n++) {
+    		shards[n].corestart = firstsample + (nframes * n / shardcount) * framesize;
+    		shards[n].end = firstsample + (nframes * (n+1) / shardcount) * framesize;
+    		shards[n].readstart = shards[n].corestart - overlap;
+
+    		if (shards[n].readstart < firstsample)
+    			shards[n].readstart = firstsample;
+
+    		if (hasOutputFile)
+    			shards[n].file = base + "_" + std::to_string(n) + ext;
+    	}
+
+    	if (hasOutputFile) {
+    		// Each worker has its own reader / writer, so shards go out in parallel.  The readers
+    		// are opened here and each shard's failure is kept: the workers can't ErrorExit().
+    		int nthreads = WorkerThreads();
+
+    		if (nthreads > shardcount)
+    			nthreads = shardcount;
+
+    		std::vector< std::unique_ptr<file_reader> > readers;
+
+    		if (!OpenWorkerReaders(nthreads, readers)) {
+    			ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    			ErrorExit();
+    		}
+
+    		std::vector<std::string> failures(shardcount);
+    		std::atomic<int> nextshard(0);
+    		std::vector<std::thread> workers;
+
+    		for (int t=0;t<nthreads;t++) {
+    			file_reader *reader = readers[t].get();
+
+    			workers.push_back(std::thread([this, reader, &shards, &failures, &nextshard]() {
+    				int n;
+
+    				while ((n = nextshard++) < shardcount) {
+    					try {
+    						if (!WriteShard(*reader, shards[n]))
+    							failures[n] = "Unable to open output file " + shards[n].file;
+    					}
+    					catch (std::exception &e) {
+    						failures[n] = "Shard " + std::to_string(n) + ": " + e.what();
+    					}
+    				}
+    			}));
+    		}
+
+    		for (size_t t=0;t<workers.size();t++)
+    			workers[t].join();
+
+    		readers.clear();
+
+    		int nfailed = 0;
+
+    		for (int n=0;n<shardcount;n++) {
+    			if (failures[n].length() > 0) {
+    				ErrorOut() << "ERROR: " << failures[n] << std::endl;
+    				nfailed++;
+    			}
+    		}
+
+    		if (nfailed > 0) {
+    			ErrorOut() << "ERROR: " << nfailed << " of " << shardcount << " shards weren't written." << std::endl;
+    			ErrorExit();
+    		}
+
+    		std::string manifestfile = base + ".manifest.json";
+    		ofstream manifest(manifestfile);
+
+    		if (!manifest.is_open()) {
+    			ErrorOut() << "ERROR: Unable to write to " << manifestfile << std::endl;
+    			ErrorExit();
+    		}
+
+    		WriteShardManifest(manifest, shards);
+    		manifest.close();
+
+    		std::cout << "INFO: Wrote " << shardcount << " shards.  Manifest: " << manifestfile << std::endl;
+    	}
+    	else {
+    		// Plan only
+    		WriteShardManifest(std::cout, shards);
+    	}
+
+    	return 0;
+    }
+
+    bool sqlsource_impl::WriteShard(file_reader &reader, const shard_range &shard) {
+    	// Runs on a worker thread with that worker's reader.  Returns false if the shard's
+    	// file can't be created instead of exiting.
+    	file_writer writer(shard.file, iopolicy, readahead);
+
+    	if (!writer.is_open())
+    		return false;
+
+    	CopyRange(&reader, &writer, shard.readstart * datatypesize, shard.end * datatypesize);
+    	writer.close();
+
+    	return true;
+    }
+
+    void sqlsource_impl::WriteShardManifest(std::ostream &out, const std::vector<shard_range> &shards) {
+    	// Sample numbers are from the start of the source file.  Byte ranges are in the
+    	// source file; each shard file holds end - read_start_sample output items.
+    	out << "{" << std::endl;
+    	out << "  \"source\": " << JsonQuoted(filename) << "," << std::endl;
+    	out << "  \"samplerate\": " << samplerate << "," << std::endl;
+    	out << "  \"input_item_size\": " << datatypesize << "," << std::endl;
+    	out << "  \"output_item_size\": " << GetOutputItemSize() << "," << std::endl;
+    	out << "  \"vlen\": " << vlen << "," << std::endl;
+    	out << "  \"overlap_samples\": " << ((shardoverlap + vlen - 1) / vlen) * vlen << "," << std::endl;
+    	out << "  \"shards\": [" << std::endl;
+
+    	for (size_t n=0;n<shards.size();n++) {
+    		const shard_range &shard = shards[n];
+
+    		out << "    {\"index\": " << n;
+
+    		if (shard.file.length() > 0)
+    			out << ", \"file\": " << JsonQuoted(shard.file);
+
+    		out << ", \"start_sample\": " << shard.corestart << ", \"end_sample\": " << shard.end
+    				<< ", \"read_start_sample\": " << shard.readstart << ", \"lead_in_samples\": " << shard.corestart - shard.readstart
+    				<< ", \"byte_offset\": " << shard.readstart * datatypesize << ", \"byte_length\": " << (shard.end - shard.readstart) * datatypesize
+    				<< "}" << (n + 1 < shards.size() ? "," : "") << std::endl;
+    	}
+
+    	out << "  ]" << std::endl;
+    	out << "}" << std::endl;
+    }
+
+    bool sqlsource_impl::start() {
+    	// Find everything up front (in parallel) while the rest of the flowgraph starts
+    	if (matchfile.length() > 0)
+    		StartMatchSearch();
+
+    	return true;
+    }
+
+    bool sqlsource_impl::stop() {
+    	if (matchsearch.joinable()) {
+    		matchcancel = true;
+    		matchsearch.join();
+    	}
+
+    	if (realtime && rtstarted) {
+    		double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - rtplaystart).count();
+    		double played = (double)rttotalitems / rtitemrate;
+
+    		std::cout << "INFO: REALTIME played " << std::fixed << std::setprecision(3) << played << " sec in " << elapsed << " sec.  Max late "
+    				<< rtmaxlate * 1000.0 << " ms, " << rtunderruns << " underrun(s)." << std::endl;
+    		rtstarted = false;
+    	}
+
+    	if (pInputFile) {
+            gr::thread::scoped_lock lock(fp_mutex); // hold for the rest of this function
+    		delete pInputFile;
+    		pInputFile = NULL;
+    	}
+
+    	if (joined)
+    		joined->stop();
+
+        return true;
+    }
+
+    /*
+     * Our virtual destructor.
+     */
+    sqlsource_impl::~sqlsource_impl()
+    {
+    	stop();
+    	Release();
+    }
+
+    void sqlsource_impl::parsesql(bool ignore_nosaveas) {
+    	// This function breaks down the SQL statement into its representative components and does any initialization such as making sure the input file
+    	// exists and opening the file pointer.
+
+    	if (sqlstring.length() == 0) {
+    		ErrorOut() << "ERROR: Please provide a grsql SQL string." << std::endl;
+    		ErrorExit();
+    	}
+
+		std::regex rgxselect("SELECT ?(\\*|I|Q|WATERFALL|FREQUENCY|CONSTELLATION|HEALTH|TIMELENGTH)",std::regex_constants::icase);
+		std::regex rgxinsert("^ *INSERT INTO",std::regex_constants::icase);
+		std::regex rgxfile(" FROM '?(.*?)'",std::regex_constants::icase);
+		std::regex rgxdatatype(" ASDATATYPE ?(COMPLEX|FLOAT|INT|SHORT|BYTE|HACKRF|RTLSDR|SIGNED8|UNSIGNED8|SC16|SC12|SC8)",std::regex_constants::icase);
+		std::regex rgxsamplerate(" SAMPLERATE ?([0-9]{1,}\\.?[0-9]{0,}M?)",std::regex_constants::icase);
+		std::regex rgxstarttime(" (STARTTIME|STARTATTIMEOFFSET) ?([0-9]{1,}(:[0-9]{1,}){0,2}\\.?[0-9]{0,})",std::regex_constants::icase);
+		std::regex rgxendtime(" (ENDTIME|ENDATTIMEOFFSET) ?([0-9]{1,}(:[0-9]{1,}){0,2}\\.?[0-9]{0,})",std::regex_constants::icase);
+		std::regex rgxstartsample(" STARTATSAMPLE ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxendsample(" ENDATSAMPLE ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxshard(" SHARD INTO ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxoverlap(" OVERLAP ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxsaveas(" SAVEAS '?(.*?)'",std::regex_constants::icase);
+		std::regex rgxvlen(" VLEN ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxiopolicy(" IOPOLICY ?(NORMAL|SEQUENTIAL|DROPBEHIND|DIRECT)",std::regex_constants::icase);
+		std::regex rgxreadahead(" READAHEAD ?([0-9]{1,}\\.?[0-9]{0,}[KM]?)",std::regex_constants::icase);
+		std::regex rgxresample(" RESAMPLE TO ?([0-9]{1,}\\.?[0-9]{0,}M?)",std::regex_constants::icase);
+		std::regex rgxdecimate(" DECIMATE ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxtaps(" TAPS ?(AUTO|[0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxcenter(" CENTER ?(-?[0-9]{1,}\\.?[0-9]{0,}[KM]?)",std::regex_constants::icase);
+		std::regex rgxbandwidth(" BANDWIDTH ?([0-9]{1,}\\.?[0-9]{0,}[KM]?)",std::regex_constants::icase);
+		std::regex rgxchannels(" CHANNELS AT ?\\(([^\\)]*)\\)",std::regex_constants::icase);
+		std::regex rgxjoin(" JOIN '?(.*?)'((?: (?:ASDATATYPE|SAMPLERATE) ?[^ ]+)*) ON TIME OFFSET ?(-?)([0-9]{1,}(:[0-9]{1,}){0,2}\\.?[0-9]{0,})",std::regex_constants::icase);
+		std::regex rgxmatches(" WHERE MATCHES '?(.*?)'",std::regex_constants::icase);
+		std::regex rgxthreshold(" THRESHOLD ?([0-9]{0,}\\.?[0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxwindow(" WINDOW ?([0-9]{1,}) ?, ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxbins(" BINS ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxrange(" RANGE ?(AUTO|[0-9]{0,}\\.?[0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxannotation(" WHERE ANNOTATION LABEL ?= ?'([^']*)'",std::regex_constants::icase);
+		std::regex rgxpad(" PAD ?([0-9]{0,}\\.?[0-9]{1,}) ?(MS|US|S|SAMPLES)?\\b",std::regex_constants::icase);
+		std::regex rgxsplit(" SPLIT( |$)",std::regex_constants::icase);
+		std::regex rgxmindropout(" MINDROPOUT ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxmergegap(" MERGEGAP ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxinterleave(" INTERLEAVED?( |$)",std::regex_constants::icase);
+		std::regex rgxfollow(" FOLLOW( |$)",std::regex_constants::icase);
+		std::regex rgxlatency(" LATENCY ?([0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxidle(" IDLE ?([0-9]{0,}\\.?[0-9]{1,})",std::regex_constants::icase);
+		std::regex rgxrealtime(" REALTIME( |$)",std::regex_constants::icase);
+		std::regex rgxspeedup(" SPEEDUP ?([0-9]{1,}\\.?[0-9]{0,})",std::regex_constants::icase);
+		std::regex rgxchunk(" CHUNK ?([0-9]{1,})",std::regex_constants::icase);
+		std::smatch match;
+
+		// Pull the JOIN clause out first so its ASDATATYPE / SAMPLERATE aren't taken for the main file's
+		if ( std::regex_search(sqlstring, match, rgxjoin) ) {
+			joinfile = match[1];
+			joinoptions = match[2];
+			joinoffsetnegative = (match[3] == "-");
+			joinoffset = match[4];
+			sqlstring = match.prefix().str() + match.suffix().str();
+		}
+		else if (sqlstring.find(" JOIN ") != std::string::npos) {
+			ErrorOut() << "ERROR: JOIN needs a time offset.  ex: JOIN 'rx2.raw' ON TIME OFFSET 0.000125" << std::endl;
+			ErrorExit();
+		}
+
+		// Find if we have a SELECT or INSERT
+    	if ( std::regex_search(sqlstring, match, rgxselect) ) {
+    		// SELECT CLAUSE
+    		sqlAction = GRSQL_SELECT;
+    	        //std::cout << "Found SELECT clause\n";
+    	        std::string strselectaction=match[1];
+    	        boost::to_upper(strselectaction);
+    	        // std::cout << "matched string = " << selectaction << '\n';
+    	        if (strselectaction == "TIMELENGTH") {
+    	        	selectAction = SELECT_TIMELENGTH;
+    	        } else if (strselectaction == "*") {
+    	        	selectAction = SELECT_STAR;
+				} else if (strselectaction == "I") {
+					selectAction = SELECT_I;
+				} else if (strselectaction == "Q") {
+					selectAction = SELECT_Q;
+				} else if (strselectaction == "CONSTELLATION") {
+					selectAction = SELECT_CONSTELLATION;
+				} else if (strselectaction == "HEALTH") {
+					selectAction = SELECT_HEALTH;
+				}
+				else {
+					ErrorOut() << "ERROR: Unknown select action: " << strselectaction << std::endl;
+					ErrorExit();
+				}
+    	        // Find the filename:
+    	    	if ( std::regex_search(sqlstring, match, rgxfile) ) {
+    	    	        filename=match[1];
+    	    	        // std::cout << "filename: " << filename << std::endl;
+
+    	    	        // now see if file exists:
+    	    			std::ifstream infile;
+
+    	    			try {
+    	    				infile.open (filename);
+    	    			}
+    	    			catch (...) {
+    	    				ErrorOut() << "ERROR opening file: " << filename << std::endl;
+    	    				ErrorExit();
+    	    			}
+
+    	    			if (!infile.is_open()) {
+    	    				ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+    	    				ErrorExit();
+    	    			}
+
+    	    			infile.close();
+    			}
+    			else {
+    				ErrorOut() << "No source file found.  Please include FROM '<filename>' in statement (or did you forget the quotes?)." << std::endl;
+    				ErrorExit();
+    			}
+
+    	    	// Recordings made with INSERT (or other SigMF tools) carry their type and rate in a sidecar
+    	    	int sidecartype = DATATYPE_UNKNOWN;
+    	    	long sidecarrate = 0;
+    	    	ReadSidecar(filename, sidecartype, sidecarrate);
+
+    	    	// Data Type
+    	    	if ( std::regex_search(sqlstring, match, rgxdatatype) ) {
+    	    	        std::string dtype=match[1];
+    	    	        boost::to_upper(dtype);
+    	    	        // std::cout << "data type = " << dtype << '\n';
+    	    	        if (dtype == "COMPLEX") {
+    	    	        	dataType = DATATYPE_COMPLEX;
+    	    	        } else if (dtype == "FLOAT") {
+    	    	        	dataType = DATATYPE_FLOAT;
+    					} else if (dtype == "INT") {
+    						dataType = DATATYPE_INT;
+    					} else if (dtype == "SHORT") {
+    						dataType = DATATYPE_SHORT;
+						} else if (dtype == "BYTE") {
+							dataType = DATATYPE_BYTE;
+						} else if ((dtype == "HACKRF") || (dtype == "SIGNED8")) {
+							dataType = DATATYPE_SIGNED8;
+						} else if ((dtype == "RTLSDR") || (dtype == "UNSIGNED8")) {
+							dataType = DATATYPE_UNSIGNED8;
+						} else if (dtype == "SC16") {
+							dataType = DATATYPE_SC16;
+						} else if (dtype == "SC12") {
+							dataType = DATATYPE_SC12;
+						} else if (dtype == "SC8") {
+							dataType = DATATYPE_SC8;
+						}
+						else {
+							ErrorOut() << "ERROR: Unknown data type: " << dtype << std::endl;
+							ErrorExit();
+						}
+
+    	    	        if ( ((selectAction == SELECT_I) || (selectAction == SELECT_Q)) && (dataType != DATATYPE_COMPLEX) ) {
+    	    	        	ErrorOut() << "ERROR: SELECT I/Q only available for complex data types.  If working with Signed/Unsigned8 data types, use SaveAS first to convert it to copmlex then extract I/Q." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    			}
+    			else if (sidecartype != DATATYPE_UNKNOWN) {
+    				dataType = sidecartype;
+    				std::cout << "INFO: Using data type " << SigMFDataType(dataType) << " from " << SidecarFileName(filename) << std::endl;
+
+    	    	    if ( ((selectAction == SELECT_I) || (selectAction == SELECT_Q)) && (dataType != DATATYPE_COMPLEX) ) {
+    	    	    	ErrorOut() << "ERROR: SELECT I/Q only available for complex data types." << std::endl;
+    	    	    	ErrorExit();
+    	    	    }
+    			}
+    			else {
+    				ErrorOut() << "No data type specified.  Please include ASDATATYPE [COMPLEX | FLOAT | INT | SHORT | BYTE | HACKRF (alias for SIGNED8) | RTLSDR (alias for UNSIGNED8) | SIGNED8 | UNSIGNED8 | SC16 | SC12 | SC8 ] in statement." << std::endl;
+    				ErrorExit();
+    			}
+
+    	    	// Sample Rate
+    	    	if ( std::regex_search(sqlstring, match, rgxsamplerate) ) {
+    	    	        std::string srate=match[1];
+
+    	    	        samplerate = ParseRate(srate);
+    	    	        // std::cout << "sample rate = " << samplerate << " SPS" << std::endl;
+    			}
+    			else if (sidecarrate > 0) {
+    				samplerate = sidecarrate;
+    				std::cout << "INFO: Using sample rate " << samplerate << " from " << SidecarFileName(filename) << std::endl;
+    			}
+    			else {
+    				ErrorOut() << "No sample rate specified.  Please include SAMPLERATE <sample rate> in statement. Sample rate may be specified as 10000000 or 10.2M" << std::endl;
+    				ErrorExit();
+    			}
+    	    	// Start time / sample.  Times are converted to exact sample numbers (see TimeToSample)
+    	    	bool hasstarttime = std::regex_search(sqlstring, match, rgxstarttime);
+
+    	    	if (hasstarttime) {
+    	    	        std::string stime=match[2];
+
+	    	        	startsample = TimeToSample(stime);
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxstartsample) ) {
+    	    	        std::string ssample=match[1];
+
+    	    	        if (hasstarttime) {
+    	    	        	ErrorOut() << "ERROR: Please use either STARTTIME or STARTATSAMPLE, not both." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        startsample = strtoll(ssample.c_str(), NULL, 10);
+    	    	        hasstarttime = true;
+    	    	}
+
+    	    	if (!hasstarttime) {
+    	    		// Annotations are sample addressed, so they default to the whole recording
+    				if ((selectAction != SELECT_TIMELENGTH) && !std::regex_search(sqlstring, match, rgxannotation)) {
+        				ErrorOut() << "No start time specified.  Please include starttime <time as float sec> (or STARTATSAMPLE <sample #>) in statement." << std::endl;
+        				ErrorExit();
+    				}
+    			}
+
+    	    	// end time / sample
+    	    	bool hasendtime = std::regex_search(sqlstring, match, rgxendtime);
+
+    	    	if (hasendtime) {
+    	    	        std::string stime=match[2];
+
+	    	        	endsample = TimeToSample(stime);
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxendsample) ) {
+    	    	        std::string ssample=match[1];
+
+    	    	        if (hasendtime) {
+    	    	        	ErrorOut() << "ERROR: Please use either ENDTIME or ENDATSAMPLE, not both." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        endsample = strtoll(ssample.c_str(), NULL, 10);
+    	    	        hasendtime = true;
+    	    	}
+
+    	    	if (hasendtime) {
+    	    		if (endsample <= startsample) {
+    	    			ErrorOut() << "ERROR: The end needs to be after the start." << std::endl;
+    	    			ErrorExit();
+    	    		}
+    	    	}
+    	    	else {
+    				if (selectAction != SELECT_TIMELENGTH) {
+        				std::cout << "INFO: No end time specified.  Assuming end of file." << std::endl;
+    				}
+    			}
+
+    	    	// Shards
+    	    	if ( std::regex_search(sqlstring, match, rgxshard) ) {
+    	    	        std::string sshards=match[1];
+    	    	        shardcount = atoi(sshards.c_str());
+
+    	    	        if (shardcount < 1) {
+    	    	        	ErrorOut() << "ERROR: SHARD INTO needs at least 1 shard." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (ignore_nosaveas || (selectAction == SELECT_TIMELENGTH)) {
+    	    	        	ErrorOut() << "ERROR: SHARD INTO is only available for SELECT from the grsql command-line." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxoverlap) ) {
+    	    	        std::string soverlap=match[1];
+
+    	    	        if (shardcount == 0) {
+    	    	        	ErrorOut() << "ERROR: OVERLAP goes with SHARD INTO.  ex: SHARD INTO 8 OVERLAP 4096" << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        shardoverlap = strtoll(soverlap.c_str(), NULL, 10);
+    	    	}
+
+    	    	// Resample / decimate
+    	    	if ( std::regex_search(sqlstring, match, rgxresample) ) {
+    	    	        std::string srate=match[1];
+
+    	    	        resampletorate = ParseRate(srate);
+
+    	    	        if (resampletorate <= 0) {
+    	    	        	ErrorOut() << "ERROR: RESAMPLE TO needs a rate greater than 0." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxdecimate) ) {
+    	    	        std::string sdecim=match[1];
+
+    	    	        decimation = atol(sdecim.c_str());
+
+    	    	        if (decimation < 1) {
+    	    	        	ErrorOut() << "ERROR: DECIMATE needs a factor of 1 or more." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (resampletorate > 0) {
+    	    	        	ErrorOut() << "ERROR: Please use either RESAMPLE TO or DECIMATE, not both." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxtaps) ) {
+    	    	        std::string staps=match[1];
+    	    	        boost::to_upper(staps);
+
+    	    	        if (staps != "AUTO")
+    	    	        	resampletaps = atoi(staps.c_str());
+    	    	}
+
+    	    	// I/O policy
+    	    	if ( std::regex_search(sqlstring, match, rgxiopolicy) ) {
+    	    	        std::string spolicy=match[1];
+    	    	        boost::to_upper(spolicy);
+
+    	    	        if (spolicy == "SEQUENTIAL") {
+    	    	        	iopolicy = IOPOLICY_SEQUENTIAL;
+    	    	        } else if (spolicy == "DROPBEHIND") {
+    	    	        	iopolicy = IOPOLICY_DROPBEHIND;
+    	    	        } else if (spolicy == "DIRECT") {
+    	    	        	iopolicy = IOPOLICY_DIRECT;
+    	    	        }
+    	    	        else {
+    	    	        	iopolicy = IOPOLICY_NORMAL;
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxreadahead) ) {
+    	    	        std::string sreadahead=match[1];
+
+    	    	        // Sized in bytes, 64M / 512K style
+    	    	        readahead = (long)ParseFrequency(sreadahead);
+
+    	    	        if (readahead < DIRECTIOALIGNMENT) {
+    	    	        	ErrorOut() << "ERROR: READAHEAD needs to be at least " << DIRECTIOALIGNMENT << " bytes." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (iopolicy == IOPOLICY_NORMAL)
+    	    	        	iopolicy = IOPOLICY_SEQUENTIAL;
+    	    	}
+
+    	    	// Vector length
+    	    	if ( std::regex_search(sqlstring, match, rgxvlen) ) {
+    	    	        std::string svlen=match[1];
+    	    	        int sqlvlen = atoi(svlen.c_str());
+
+    	    	        if (sqlvlen < 1) {
+    	    	        	ErrorOut() << "ERROR: VLEN needs to be 1 or more." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if ((grcdatatype > 0) && (sqlvlen != vlen)) {
+    	    	        	ErrorOut() << "ERROR: Your SQL VLEN (" << sqlvlen << ") doesn't match the block's vector length (" << vlen << ")." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        vlen = sqlvlen;
+    	    	}
+
+    	    	// Real-time pacing
+    	    	if ( std::regex_search(sqlstring, match, rgxrealtime) ) {
+    	    	        realtime = true;
+
+    	    	        if (grcdatatype <= 0) {
+    	    	        	ErrorOut() << "ERROR: REALTIME paces the flowgraph block's output and isn't available from the grsql command-line." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxspeedup) ) {
+    	    	        std::string sspeedup=match[1];
+    	    	        speedup = atof(sspeedup.c_str());
+
+    	    	        if (!realtime || (speedup <= 0.0)) {
+    	    	        	ErrorOut() << "ERROR: SPEEDUP goes with REALTIME and needs to be more than 0.  ex: REALTIME SPEEDUP 2.0" << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxchunk) ) {
+    	    	        std::string schunk=match[1];
+    	    	        rtchunk = atol(schunk.c_str());
+
+    	    	        if (!realtime || (rtchunk < 1)) {
+    	    	        	ErrorOut() << "ERROR: CHUNK goes with REALTIME and needs to be at least 1 sample.  ex: REALTIME CHUNK 4096" << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	// Channelizer
+    	    	if ( std::regex_search(sqlstring, match, rgxcenter) ) {
+    	    	        std::string sfreq=match[1];
+
+    	    	        centerfreq = ParseFrequency(sfreq);
+    	    	        hascenter = true;
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxchannels) ) {
+    	    	        std::string schannels=match[1];
+    	    	        std::vector<std::string> freqs;
+    	    	        boost::split(freqs, schannels, boost::is_any_of(","));
+
+    	    	        for (size_t c=0;c<freqs.size();c++) {
+    	    	        	boost::trim(freqs[c]);
+
+    	    	        	if (freqs[c].length() > 0)
+    	    	        		channelcenters.push_back(ParseFrequency(freqs[c]));
+    	    	        }
+
+    	    	        if (channelcenters.size() == 0) {
+    	    	        	ErrorOut() << "ERROR: CHANNELS AT needs at least one center frequency, ex: CHANNELS AT (-2.5M, 0, 1.25M)" << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (hascenter) {
+    	    	        	ErrorOut() << "ERROR: Please use either CENTER or CHANNELS AT, not both." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (ignore_nosaveas) {
+    	    	        	ErrorOut() << "ERROR: CHANNELS AT writes one file per channel and is only available from the grsql command-line.  Use CENTER in the flowgraph block." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxbandwidth) ) {
+    	    	        std::string sbw=match[1];
+
+    	    	        bandwidth = ParseFrequency(sbw);
+    	    	}
+    	    	else {
+    	    		if (hascenter || (channelcenters.size() > 0)) {
+    	    			ErrorOut() << "ERROR: CENTER / CHANNELS AT need a BANDWIDTH <Hz> for the channel." << std::endl;
+    	    			ErrorExit();
+    	    		}
+    	    	}
+
+    	    	// JOIN
+    	    	if (joinfile.length() > 0) {
+    	    		if ((selectAction == SELECT_TIMELENGTH) || (shardcount > 0) || (channelcenters.size() > 0)) {
+    	    			ErrorOut() << "ERROR: JOIN can't be combined with TIMELENGTH, SHARD INTO or CHANNELS AT." << std::endl;
+    	    			ErrorExit();
+    	    		}
+
+    	    		if (grcdatatype == DATATYPE_QUERY) {
+    	    			ErrorOut() << "ERROR: JOIN produces two streams.  Please run a query for each recording instead." << std::endl;
+    	    			ErrorExit();
+    	    		}
+    	    	}
+
+    	    	// CONSTELLATION
+    	    	if (selectAction == SELECT_CONSTELLATION) {
+    	    		if ((dataType == DATATYPE_FLOAT) || (dataType == DATATYPE_INT) || (dataType == DATATYPE_SHORT) || (dataType == DATATYPE_BYTE)) {
+    	    			ErrorOut() << "ERROR: SELECT CONSTELLATION needs a complex (I/Q) data type." << std::endl;
+    	    			ErrorExit();
+    	    		}
+
+    	    		if (ignore_nosaveas) {
+    	    			ErrorOut() << "ERROR: SELECT CONSTELLATION writes a histogram file and is only available from the grsql command-line." << std::endl;
+    	    			ErrorExit();
+    	    		}
+
+    	    		if ((shardcount > 0) || (joinfile.length() > 0) || (vlen > 1) || (resampletorate > 0) || (decimation > 0) || hascenter || (channelcenters.size() > 0)) {
+    	    			ErrorOut() << "ERROR: SELECT CONSTELLATION can't be combined with SHARD INTO, JOIN, VLEN, RESAMPLE, DECIMATE, CENTER or CHANNELS AT." << std::endl;
+    	    			ErrorExit();
+    	    		}
+
+    	    		if ( std::regex_search(sqlstring, match, rgxbins) ) {
+    	    			std::string sbins=match[1];
+    	    			constellationbins = atoi(sbins.c_str());
+
+    	    			if ((constellationbins < 2) || (constellationbins > CONSTELLATIONMAXBINS)) {
+    	    				ErrorOut() << "ERROR: BINS needs to be between 2 and " << CONSTELLATIONMAXBINS << "." << std::endl;
+    	    				ErrorExit();
+    	    			}
+    	    		}
+
+    	    		if ( std::regex_search(sqlstring, match, rgxrange) ) {
+    	    			std::string srange=match[1];
+    	    			boost::to_upper(srange);
+
+    	    			if (srange != "AUTO")
+    	    				constellationrange = atof(srange.c_str());
+    	    		}
+    	    		else if (dataType != DATATYPE_COMPLEX) {
+    	    			// Integer recordings are converted to +/- 1 full scale
+    	    			constellationrange = 1.0;
+    	    		}
+    	    	}
+
+    	    	// WHERE ANNOTATION LABEL = '<label>'
+    	    	if ( std::regex_search(sqlstring, match, rgxannotation) ) {
+    	    	        annotationlabel = match[1];
+
+    	    	        if (annotationlabel.length() == 0) {
+    	    	        	ErrorOut() << "ERROR: WHERE ANNOTATION LABEL needs a label.  ex: WHERE ANNOTATION LABEL = 'burst'" << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if ( std::regex_search(sqlstring, match, rgxpad) ) {
+    	    	        	std::string spad=match[1];
+    	    	        	std::string sunit=match[2];
+    	    	        	boost::to_upper(sunit);
+
+    	    	        	if ((sunit.length() == 0) || (sunit == "SAMPLES")) {
+    	    	        		annotationpad = strtoll(spad.c_str(), NULL, 10);
+    	    	        	}
+    	    	        	else {
+    	    	        		double mult = (sunit == "MS") ? 1e-3 : ((sunit == "US") ? 1e-6 : 1.0);
+    	    	        		annotationpad = llround(atof(spad.c_str()) * mult * (double)samplerate);
+    	    	        	}
+    	    	        }
+
+    	    	        annotationsplit = std::regex_search(sqlstring, match, rgxsplit);
+
+    	    	        if ((selectAction == SELECT_TIMELENGTH) || (selectAction == SELECT_CONSTELLATION) || (selectAction == SELECT_HEALTH) || (shardcount > 0) ||
+    	    	        		(joinfile.length() > 0) || (vlen > 1) || (resampletorate > 0) || (decimation > 0) || hascenter || (channelcenters.size() > 0) ||
+    	    	        		std::regex_search(sqlstring, match, rgxmatches)) {
+    	    	        	ErrorOut() << "ERROR: WHERE ANNOTATION reads the recording as-is and can't be combined with TIMELENGTH, CONSTELLATION, HEALTH, SHARD INTO, JOIN, VLEN, RESAMPLE, DECIMATE, CENTER, CHANNELS AT or WHERE MATCHES." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (grcdatatype == DATATYPE_QUERY) {
+    	    	        	ErrorOut() << "ERROR: WHERE ANNOTATION isn't available from the query API.  Use grsql to write the segments and manifest." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (annotationsplit && ignore_nosaveas) {
+    	    	        	ErrorOut() << "ERROR: SPLIT writes one file per annotation and is only available from the grsql command-line." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	// HEALTH
+    	    	if (selectAction == SELECT_HEALTH) {
+    	    		if (ignore_nosaveas) {
+    	    			ErrorOut() << "ERROR: SELECT HEALTH is only available from the grsql command-line." << std::endl;
+    	    			ErrorExit();
+    	    		}
+
+    	    		if ((shardcount > 0) || (joinfile.length() > 0) || (vlen > 1) || (resampletorate > 0) || (decimation > 0) || hascenter || (channelcenters.size() > 0)) {
+    	    			ErrorOut() << "ERROR: SELECT HEALTH looks at the recorded samples and can't be combined with SHARD INTO, JOIN, VLEN, RESAMPLE, DECIMATE, CENTER or CHANNELS AT." << std::endl;
+    	    			ErrorExit();
+    	    		}
+
+    	    		if ( std::regex_search(sqlstring, match, rgxmindropout) ) {
+    	    			std::string sdropout=match[1];
+    	    			healthmindropout = strtoll(sdropout.c_str(), NULL, 10);
+
+    	    			if (healthmindropout < 1) {
+    	    				ErrorOut() << "ERROR: MINDROPOUT needs to be at least 1 sample." << std::endl;
+    	    				ErrorExit();
+    	    			}
+    	    		}
+
+    	    		if ( std::regex_search(sqlstring, match, rgxmergegap) ) {
+    	    			std::string sgap=match[1];
+    	    			healthmergegap = strtoll(sgap.c_str(), NULL, 10);
+    	    		}
+    	    	}
+
+    	    	// FOLLOW
+    	    	if ( std::regex_search(sqlstring, match, rgxfollow) ) {
+    	    	        follow = true;
+    	    	        followidle = (grcdatatype > 0) ? 0.0 : FOLLOWDEFAULTIDLESEC;
+
+    	    	        if ( std::regex_search(sqlstring, match, rgxlatency) ) {
+    	    	        	std::string slatency=match[1];
+    	    	        	followlatency = atoi(slatency.c_str());
+    	    	        }
+
+    	    	        if ( std::regex_search(sqlstring, match, rgxidle) ) {
+    	    	        	std::string sidle=match[1];
+    	    	        	followidle = atof(sidle.c_str());
+    	    	        }
+
+    	    	        if ((selectAction == SELECT_TIMELENGTH) || (selectAction == SELECT_CONSTELLATION) || (selectAction == SELECT_HEALTH) || (shardcount > 0) ||
+    	    	        		(joinfile.length() > 0) || (channelcenters.size() > 0) || (annotationlabel.length() > 0) || std::regex_search(sqlstring, match, rgxmatches)) {
+    	    	        	ErrorOut() << "ERROR: FOLLOW streams a recording as it grows and can't be combined with TIMELENGTH, CONSTELLATION, HEALTH, SHARD INTO, JOIN, CHANNELS AT, WHERE MATCHES or WHERE ANNOTATION." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (grcdatatype == DATATYPE_QUERY) {
+    	    	        	ErrorOut() << "ERROR: FOLLOW isn't available from the query API." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+    	    	else if ( std::regex_search(sqlstring, match, rgxlatency) || std::regex_search(sqlstring, match, rgxidle) ) {
+    	    	        ErrorOut() << "ERROR: LATENCY and IDLE go with FOLLOW.  ex: FOLLOW LATENCY 50 IDLE 30" << std::endl;
+    	    	        ErrorExit();
+    	    	}
+
+    	    	// WHERE MATCHES
+    	    	if ( std::regex_search(sqlstring, match, rgxmatches) ) {
+    	    	        matchfile = match[1];
+
+    	    	        if ( std::regex_search(sqlstring, match, rgxthreshold) ) {
+    	    	        	std::string sthreshold=match[1];
+    	    	        	matchthreshold = atof(sthreshold.c_str());
+    	    	        }
+
+    	    	        if ((matchthreshold <= 0.0) || (matchthreshold > 1.0)) {
+    	    	        	ErrorOut() << "ERROR: WHERE MATCHES needs a THRESHOLD between 0 and 1 (normalized correlation).  ex: THRESHOLD 0.7" << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if ( std::regex_search(sqlstring, match, rgxwindow) ) {
+    	    	        	std::string sbefore=match[1];
+    	    	        	std::string safter=match[2];
+    	    	        	matchbefore = strtoll(sbefore.c_str(), NULL, 10);
+    	    	        	matchafter = strtoll(safter.c_str(), NULL, 10);
+    	    	        }
+
+    	    	        if ((selectAction == SELECT_TIMELENGTH) || (selectAction == SELECT_CONSTELLATION) || (selectAction == SELECT_HEALTH) || (shardcount > 0) || (joinfile.length() > 0) || (vlen > 1) ||
+    	    	        		(resampletorate > 0) || (decimation > 0) || hascenter || (channelcenters.size() > 0)) {
+    	    	        	ErrorOut() << "ERROR: WHERE MATCHES searches the recording as-is and can't be combined with TIMELENGTH, CONSTELLATION, HEALTH, SHARD INTO, JOIN, VLEN, RESAMPLE, DECIMATE, CENTER or CHANNELS AT." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        if (grcdatatype == DATATYPE_QUERY) {
+    	    	        	ErrorOut() << "ERROR: WHERE MATCHES isn't available from the query API.  Use grsql to write the windows and manifest." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+    	    	}
+
+    	    	if ( std::regex_search(sqlstring, match, rgxinterleave) ) {
+    	    	        if ((joinfile.length() == 0) || ignore_nosaveas) {
+    	    	        	ErrorOut() << "ERROR: INTERLEAVED goes with JOIN ... SAVEAS on the grsql command-line." << std::endl;
+    	    	        	ErrorExit();
+    	    	        }
+
+    	    	        joininterleave = true;
+    	    	}
+
+    	    	if ((shardcount > 0) && ((resampletorate > 0) || (decimation > 0) || hascenter || (channelcenters.size() > 0))) {
+    	    		ErrorOut() << "ERROR: SHARD INTO splits the recording as-is.  Shard first (with OVERLAP) and then RESAMPLE / DECIMATE / CENTER each shard." << std::endl;
+    	    		ErrorExit();
+    	    	}
+
+    	    	// save as
+    	    	if ( std::regex_search(sqlstring, match, rgxsaveas) ) {
+    	    	        outputfile=match[1];
+    	    	        // std::cout << "output file: " << outputfile << std::endl;
+    			}
+    			else {
+    				if ((selectAction != SELECT_TIMELENGTH) && (selectAction != SELECT_HEALTH) && (!ignore_nosaveas) && (shardcount == 0) && (matchfile.length() == 0) && (annotationlabel.length() == 0)) {
+        				ErrorOut() << "No output file found.  Please include SAVEAS '<filename>' in statement (or did you forget the quotes?)." << std::endl;
+        				ErrorExit();
+    				}
+    			}
+
+		}
+		else if (std::regex_search(sqlstring, match, rgxinsert)) {
+			sqlAction = GRSQL_INSERT;
+			ErrorOut() << "ERROR: INSERT INTO records from a flowgraph.  Use the sqlsink block." << std::endl;
+			ErrorExit();
+		}
+		else {
+			ErrorOut() << "No select clause found." << std::endl;
+			ErrorExit();
+		}
+
+    	// Fields are populated.
+    }
+
+    long sqlsource_impl::ParseRate(std::string srate) {
+    	// Rates can be given as 10000000 or 10.2M
+    	// Rounded so 2.048M is exactly 2048000 and not 2047999
+    	boost::to_upper(srate);
+
+        if (srate.find("M") != std::string::npos) {
+        	boost::replace_all(srate,"M","");
+        	return llround(atof(srate.c_str()) * 1000000.0);
+        }
+        else {
+        	return llround(atof(srate.c_str()));
+        }
+    }
+
+    double sqlsource_impl::ParseFrequency(std::string sfreq) {
+    	// Frequencies / offsets can be negative and given as 250000, 250K or 0.25M (sizes as 64M or 4G)
+    	double mult = 1.0;
+    	boost::to_upper(sfreq);
+
+        if (sfreq.find("G") != std::string::npos) {
+        	boost::replace_all(sfreq,"G","");
+        	mult = 1000000000.0;
+        }
+        else if (sfreq.find("M") != std::string::npos) {
+        	boost::replace_all(sfreq,"M","");
+        	mult = 1000000.0;
+        }
+        else if (sfreq.find("K") != std::string::npos) {
+        	boost::replace_all(sfreq,"K","");
+        	mult = 1000.0;
+        }
+
+        return atof(sfreq.c_str()) * mult;
+    }
+
+    std::string sqlsource_impl::SidecarFileName(std::string datafile) {
+    	// capture.sigmf-data / capture.raw -> capture.sigmf-meta
+    	size_t dotpos = datafile.find_last_of('.');
+    	size_t slashpos = datafile.find_last_of('/');
+
+    	if ((dotpos != std::string::npos) && ((slashpos == std::string::npos) || (dotpos > slashpos))) {
+    		datafile = datafile.substr(0, dotpos);
+    	}
+
+    	return datafile + ".sigmf-meta";
+    }
+
+    std::string sqlsource_impl::JsonQuoted(const std::string &str) {
+    	// JSON string literal for the manifests and reports: paths and SigMF labels can hold
+    	// quotes, backslashes or control characters
+    	std::string q = "\"";
+
+    	for (size_t c=0;c<str.length();c++) {
+    		unsigned char ch = (unsigned char)str[c];
+
+    		if ((ch == '"') || (ch == '\\')) {
+    			q += '\\';
+    			q += str[c];
+    		}
+    		else if (ch < 0x20) {
+    			char esc[8];
+    			snprintf(esc, sizeof(esc), "\\u%04x", ch);
+    			q += esc;
+    		}
+    		else {
+    			q += str[c];
+    		}
+    	}
+
+    	return q + "\"";
+    }
+
+    std::string sqlsource_impl::DataTypeName(int dtype) {
+    	// ASDATATYPE keyword for a type
+    	switch (dtype) {
+    	case DATATYPE_COMPLEX: return "COMPLEX";
+    	case DATATYPE_FLOAT: return "FLOAT";
+    	case DATATYPE_INT: return "INT";
+    	case DATATYPE_SHORT: return "SHORT";
+    	case DATATYPE_BYTE: return "BYTE";
+    	case DATATYPE_SIGNED8: return "SIGNED8";
+    	case DATATYPE_UNSIGNED8: return "UNSIGNED8";
+    	case DATATYPE_SC16: return "SC16";
+    	case DATATYPE_SC12: return "SC12";
+    	case DATATYPE_SC8: return "SC8";
+    	}
+
+    	return "";
+    }
+
+    std::string sqlsource_impl::SigMFDataType(int dtype) {
+    	switch (dtype) {
+    	case DATATYPE_COMPLEX:
+    		return "cf32_le";
+    	case DATATYPE_FLOAT:
+    		return "rf32_le";
+    	case DATATYPE_INT:
+    		return "ri32_le";
+    	case DATATYPE_SHORT:
+    		return "ri16_le";
+    	case DATATYPE_BYTE:
+    		return "ru8";
+    	case DATATYPE_SIGNED8:
+    	case DATATYPE_SC8:
+    		return "ci8";
+    	case DATATYPE_UNSIGNED8:
+    		return "cu8";
+    	case DATATYPE_SC16:
+    		return "ci16_le";
+    	case DATATYPE_SC12:
+    		// Not a SigMF type, but keeps the round trip working
+    		return "ci12_le";
+    	}
+
+    	return "";
+    }
+
+    int sqlsource_impl::DataTypeFromSigMF(std::string sigmftype) {
+    	boost::to_lower(sigmftype);
+
+    	if (sigmftype == "cf32_le")
+    		return DATATYPE_COMPLEX;
+    	if (sigmftype == "rf32_le")
+    		return DATATYPE_FLOAT;
+    	if (sigmftype == "ri32_le")
+    		return DATATYPE_INT;
+    	if (sigmftype == "ri16_le")
+    		return DATATYPE_SHORT;
+    	if (sigmftype == "ru8")
+    		return DATATYPE_BYTE;
+    	if (sigmftype == "ci8")
+    		return DATATYPE_SC8;
+    	if (sigmftype == "cu8")
+    		return DATATYPE_UNSIGNED8;
+    	if (sigmftype == "ci16_le")
+    		return DATATYPE_SC16;
+    	if (sigmftype == "ci12_le")
+    		return DATATYPE_SC12;
+
+    	return DATATYPE_UNKNOWN;
+    }
+
+    // grsql --serve: parsed sidecars by absolute path
+    struct cached_sidecar
+    {
+    	dev_t dev;
+    	ino_t ino;
+    	off_t size;
+    	struct timespec mtime;
+    	sidecar_info info;
+    };
+
+    static bool sidecarcaching = false;
+    static std::mutex sidecarcache_mutex;
+    static std::map<std::string, cached_sidecar> sidecarcache;
+
+    void sqlsource_impl::CacheSidecars(bool enable) {
+    	std::lock_guard<std::mutex> lock(sidecarcache_mutex);
+
+    	sidecarcaching = enable;
+    	sidecarcache.clear();
+    }
+
+    void sqlsource_impl::PrimeSidecars(std::string sqlstring, std::string cwd) {
+    	// Same patterns parsesql uses for the files a query reads
+		std::regex rgxfile(" FROM '?(.*?)'",std::regex_constants::icase);
+		std::regex rgxjoin(" JOIN '?(.*?)'",std::regex_constants::icase);
+		std::regex rgxannotation(" WHERE ANNOTATION ",std::regex_constants::icase);
+		std::smatch match;
+		sidecar_info info;
+
+		if (!sidecarcaching)
+			return;
+
+		bool annotations = std::regex_search(sqlstring, match, rgxannotation);
+
+		if ( std::regex_search(sqlstring, match, rgxfile) ) {
+			std::string datafile = match[1];
+
+			if ((datafile.length() > 0) && (datafile[0] != '/') && (cwd.length() > 0))
+				datafile = cwd + "/" + datafile;
+
+			LoadSidecar(datafile, annotations, info);
+		}
+
+		if ( std::regex_search(sqlstring, match, rgxjoin) ) {
+			std::string datafile = match[1];
+
+			if ((datafile.length() > 0) && (datafile[0] != '/') && (cwd.length() > 0))
+				datafile = cwd + "/" + datafile;
+
+			LoadSidecar(datafile, false, info);
+		}
+    }
+
+    bool sqlsource_impl::LoadSidecar(std::string datafile, bool annotations, sidecar_info &info) {
+    	std::string metafile = SidecarFileName(datafile);
+    	std::string key;
+    	struct stat st;
+
+    	if (stat(metafile.c_str(), &st) != 0)
+    		return false;
+
+    	if (sidecarcaching) {
+    		key = metafile;
+
+    		if ((key.length() > 0) && (key[0] != '/')) {
+    			char cwd[PATH_MAX];
+
+    			if (getcwd(cwd, sizeof(cwd)) != NULL)
+    				key = std::string(cwd) + "/" + key;
+    		}
+
+    		std::lock_guard<std::mutex> lock(sidecarcache_mutex);
+    		std::map<std::string, cached_sidecar>::iterator it = sidecarcache.find(key);
+
+    		if ((it != sidecarcache.end()) && (it->second.dev == st.st_dev) && (it->second.ino == st.st_ino) && (it->second.size == st.st_size) &&
+    				(it->second.mtime.tv_sec == st.st_mtim.tv_sec) && (it->second.mtime.tv_nsec == st.st_mtim.tv_nsec) &&
+    				(!annotations || it->second.info.hasannotations)) {
+    			info = it->second.info;
+    			return true;
+    		}
+    	}
+
+    	// Only the two global fields (and the annotations if asked for) are needed
+    	std::ifstream meta(metafile);
+
+    	if (!meta.is_open())
+    		return false;
+
+    	std::stringstream contents;
+    	contents << meta.rdbuf();
+    	std::string text = contents.str();
+
+    	std::string stype;
+    	std::string srate;
+
+		info.dtype = DATATYPE_UNKNOWN;
+		info.rate = 0;
+		info.hasannotations = false;
+		info.annotations.clear();
+
+		if ( JsonStringField(text, "core:datatype", stype) )
+			info.dtype = DataTypeFromSigMF(stype);
+
+		if ( JsonNumberField(text, "core:sample_rate", srate) )
+			info.rate = llround(atof(srate.c_str()));
+
+		if (annotations) {
+			ParseSidecarAnnotations(text, info.annotations);
+			info.hasannotations = true;
+		}
+
+		if (sidecarcaching) {
+			std::lock_guard<std::mutex> lock(sidecarcache_mutex);
+
+			if (sidecarcache.size() >= SIDECARCACHEMAX)
+				sidecarcache.clear();
+
+			cached_sidecar &entry = sidecarcache[key];
+			entry.dev = st.st_dev;
+			entry.ino = st.st_ino;
+			entry.size = st.st_size;
+			entry.mtime = st.st_mtim;
+			entry.info = info;
+		}
+
+		return true;
+    }
+
+    bool sqlsource_impl::ReadSidecar(std::string datafile, int &dtype, long &rate) {
+    	sidecar_info info;
+
+    	if (!LoadSidecar(datafile, false, info))
+    		return false;
+
+    	if (info.dtype != DATATYPE_UNKNOWN)
+    		dtype = info.dtype;
+
+    	if (info.rate > 0)
+    		rate = info.rate;
+
+    	return true;
+    }
+
+    long sqlsource_impl::GetFileSize(std::string filename)
+    {
+        struct stat stat_buf;
+        int rc = stat(filename.c_str(), &stat_buf);
+        return rc == 0 ? stat_buf.st_size : -1;
+    }
+
+    int sqlsource_impl::GetDataTypeSize() {
+    	int retVal = 1;
+
+    	switch (dataType) {
+    	case DATATYPE_COMPLEX:
+    		retVal = 8;
+    	break;
+
+    	case DATATYPE_FLOAT:
+    		retVal = 4;
+    	break;
+
+    	case DATATYPE_INT:
+    		retVal = 4;
+    	break;
+
+    	case DATATYPE_SHORT:
+    		retVal = 2;
+    	break;
+
+    	case DATATYPE_BYTE:
+    		retVal = 1;
+    	break;
+
+    	// These are sized per complex sample (I+Q) so seeks always land on a sample.
+    	case DATATYPE_SIGNED8:
+    	case DATATYPE_UNSIGNED8:
+    		retVal = 2;
+    	break;
+
+    	case DATATYPE_SC16:
+    		retVal = 4;
+    	break;
+
+    	case DATATYPE_SC12:
+    		retVal = 3;
+    	break;
+
+    	case DATATYPE_SC8:
+    		retVal = 2;
+    	break;
+    	}
+
+    	return retVal;
+    }
+
+    bool sqlsource_impl::IsPackedComplex() {
+    	return ((dataType == DATATYPE_SC16) || (dataType == DATATYPE_SC12) || (dataType == DATATYPE_SC8));
+    }
+
+    int64_t sqlsource_impl::TimeToSample(std::string stime) {
+    	// Exact sample number for a time given as seconds (45.2) or [hh:]mm:ss.frac.  The
+    	// time is kept as an integer fraction (452 / 10) so there's no float rounding even
+    	// hours into a high rate recording.  Rounds down to the sample at or before the time.
+    	int64_t wholesec = 0;
+    	std::string fraction = "";
+    	size_t dotpos = stime.find('.');
+
+    	if (dotpos != std::string::npos) {
+    		fraction = stime.substr(dotpos + 1);
+    		stime = stime.substr(0, dotpos);
+    	}
+
+    	std::vector<std::string> parts;
+    	boost::split(parts, stime, boost::is_any_of(":"));
+
+    	for (size_t p=0;p<parts.size();p++) {
+    		wholesec = wholesec * 60 + strtoll(parts[p].c_str(), NULL, 10);
+    	}
+
+    	if (fraction.length() > MAXTIMEDECIMALS)
+    		fraction = fraction.substr(0, MAXTIMEDECIMALS);
+
+    	int64_t denominator = 1;
+    	int64_t numerator = 0;
+
+    	for (size_t d=0;d<fraction.length();d++) {
+    		numerator = numerator * 10 + (fraction[d] - '0');
+    		denominator = denominator * 10;
+    	}
+
+    	// samples = (wholesec + numerator / denominator) * samplerate.  128-bit keeps the
+    	// fractional product exact.
+    	__int128 fracsamples = ((__int128)numerator * (__int128)samplerate) / denominator;
+
+    	return wholesec * (int64_t)samplerate + (int64_t)fracsamples;
+    }
+
+    void sqlsource_impl::OpenInputFile() {
+    	// Open the file and set our start / end positions
+		pInputFile = new file_reader(filename, iopolicy, readahead);
+
+		if (!pInputFile->is_open()) {
+			ErrorOut() << "ERROR: Unable to open input file " << filename << std::endl;
+			ErrorExit();
+		}
+
+		long startpos;
+
+		GetFileRange(startpos, endfileposition);
+
+		curfileposition = startpos;
+
+		pInputFile->seek(startpos);
+    }
+
+    void sqlsource_impl::GetFileRange(long &startpos, long &endpos) {
+    	// Byte range in the file for the requested sample range.  Going through sample
+    	// numbers keeps packed types (SC12) on a whole sample.
+		if ((startsample >= numdatapoints) && !follow) {
+			ErrorOut() << "ERROR: start time is at or past the end of the file." << std::endl;
+			ErrorExit();
+		}
+
+		startpos = (long)(startsample * (int64_t)datatypesize);
+
+		if ((endsample == -1) || (endsample > numdatapoints)) {
+			endpos = numdatapoints * (long)datatypesize;
+		}
+		else {
+			endpos = (long)(endsample * (int64_t)datatypesize);
+		}
+
+		// FOLLOW can start ahead of the recorder
+		if (endpos < startpos)
+			endpos = startpos;
+
+		AlignToVectors(startpos, endpos);
+    }
+
+    int sqlsource_impl::ReadItems(int noutput_items, void *output) {
+    	// Reads up to noutput_items output items (after any type conversion) from the
+    	// current file position.  Returns the number of items written to output.
+		if (curfileposition >= endfileposition)
+			return 0;
+
+		size_t bytes_read = 0;
+		long bytesremaining = endfileposition - curfileposition;
+		long bytesrequested = (long)noutput_items * (long)datatypesize;
+
+		if (convert) {
+			// Converted through our read buffer.  Don't overrun it if the scheduler asks for more than it holds.
+			if (bytesrequested > FILEREADBLOCKSIZE)
+				bytesrequested = (FILEREADBLOCKSIZE / datatypesize) * datatypesize;
+
+			if (bytesremaining >= bytesrequested)
+				bytes_read = pInputFile->read(&buffer, bytesrequested);
+			else
+				bytes_read = pInputFile->read(&buffer, bytesremaining);
+
+			curfileposition = curfileposition + bytes_read;
+
+			// Only hand back whole samples
+			int returnedItems = (int)(bytes_read / datatypesize);
+			convert(buffer, returnedItems, output);
+
+			return returnedItems;
+		}
+
+		// Same type in and out, so read straight into the output buffer and skip the copy.
+		if (bytesremaining >= bytesrequested)
+			bytes_read = pInputFile->read(output, bytesrequested);
+		else
+			bytes_read = pInputFile->read(output, bytesremaining);
+
+		curfileposition = curfileposition + bytes_read;
+
+		return (int)(bytes_read / datatypesize);
+    }
+
+    template <class T>
+    int sqlsource_impl::ReadFiltered(stream_filter<T> *filter, int noutput_items, T *out) {
+    	// Anything left over from the last call goes out first
+    	int produced = (int)filter->pull(out, noutput_items);
+
+    	T *staging = (T *)&filterbuffer[0];
+    	long stagingitems = (long)(filterbuffer.size() / sizeof(T));
+
+    	while ((produced < noutput_items) && (curfileposition < endfileposition)) {
+    		long nin = filter->input_needed(noutput_items - produced);
+
+    		if (nin > stagingitems)
+    			nin = stagingitems;
+
+    		int n = ReadItems((int)nin, (void *)staging);
+
+    		if (n <= 0)
+    			break;
+
+    		filter->push(staging, n);
+    		produced = produced + (int)filter->pull(&out[produced], noutput_items - produced);
+    	}
+
+    	return produced;
+    }
+
+    int sqlsource_impl::ReadVectors(int nvectors, void *output) {
+    	// Fills nvectors * vlen samples (through any filter) unless we hit the end of the
+    	// time range.  A partial vector at the very end is dropped.
+    	long want = (long)nvectors * (long)vlen;
+    	long produced = 0;
+    	int itemsize = GetOutputItemSize();
+    	unsigned char *out = (unsigned char *)output;
+    	int n;
+
+    	while (produced < want) {
+    		long remaining = want - produced;
+    		void *dest = (void *)&out[produced * itemsize];
+
+        	if (cfilter) {
+        		n = ReadFiltered(cfilter, (int)remaining, (gr_complex *) dest);
+        	}
+        	else if (ffilter) {
+        		n = ReadFiltered(ffilter, (int)remaining, (float *) dest);
+        	}
+        	else {
+        		n = ReadItems((int)remaining, dest);
+        	}
+
+        	if (n <= 0) {
+        		// FOLLOW: hand out what we have, or if that's nothing (or part of a vector) wait for the recorder
+        		if (follow && ((produced == 0) || (produced % vlen != 0)) && FollowFile())
+        			continue;
+
+        		break;
+        	}
+
+        	produced = produced + n;
+    	}
+
+    	return (int)(produced / vlen);
+    }
+
+    int
+    sqlsource_impl::work(int noutput_items,
+        gr_vector_const_void_star &input_items,
+        gr_vector_void_star &output_items)
+    {
+    	if ((matchfile.length() > 0) && !matchready.load()) {
+    		// Outside fp_mutex so a stop() during a long search isn't held up
+    		StartMatchSearch();
+
+    		while (!matchready.load()) {
+    			if (matchcancel.load())
+    				return WORK_DONE;
+
+    			std::this_thread::sleep_for(std::chrono::milliseconds(MATCHWAITMS));
+    			boost::this_thread::interruption_point();
+    		}
+    	}
+
+        gr::thread::scoped_lock lock(fp_mutex); // hold for the rest of this function
+
+    	int returnedItems=0;
+
+       	if ((hasOutputFile) > 0) {
+    		ErrorOut() << "ERROR: output file not allowed in GR-SQL when running from a block.  Use the command-line grsql tool instead." << std::endl;
+    		ErrorExit();
+    	}
+    	// If the file isn't already open, let's open it and set our start position
+    	if (!pInputFile) {
+    		if ((joined != nullptr) != (output_items.size() > 1)) {
+    			ErrorOut() << "ERROR: The block's second output carries the JOINed recording.  Connect both outputs with JOIN and only the first without it." << std::endl;
+    			ErrorExit();
+    		}
+
+    		OpenInputFile();
+
+    		if (joined)
+    			OpenJoinedFile();
+
+    		if (matchfile.length() > 0) {
+    			// The search (start()) is done, play just the windows
+    			if (matchwindows.size() == 0)
+    				return WORK_DONE;
+
+    			SeekMatchWindow(0);
+    		}
+    		else if (annotationlabel.length() > 0) {
+    			BuildAnnotationWindows();
+
+    			if (matchwindows.size() == 0)
+    				return WORK_DONE;
+
+    			SeekMatchWindow(0);
+    		}
+    	}
+
+    	if (realtime && (noutput_items > rtchunk))
+    		noutput_items = (int)rtchunk;
+
+    	if ((matchfile.length() > 0) || (annotationlabel.length() > 0))
+    		returnedItems = ReadMatchWindows(noutput_items, output_items[0]);
+    	else
+    		returnedItems = ReadVectors(noutput_items, output_items[0]);
+
+    	if (joined && (returnedItems > 0)) {
+    		// Same number of vectors on both outputs; whichever recording ends first ends the stream
+    		int joineditems = joined->ReadVectors(returnedItems * vlen, output_items[1]) / vlen;
+
+    		if (joineditems < returnedItems)
+    			returnedItems = joineditems;
+    	}
+
+    	if (returnedItems == 0) {
+    		// Nothing left in the time range.  Let the flowgraph finish.
+    		return WORK_DONE;
+    	}
+
+    	if (realtime) {
+    		PaceOutput(returnedItems);
+    	}
 
 		// Tell runtime system how many output items we produced.
 		return returnedItems;
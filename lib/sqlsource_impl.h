@@ -22,12 +22,32 @@
 #define INCLUDED_SQL_SQLSOURCE_IMPL_H
 
 #include <sql/sqlsource.h>
+#include <gnuradio/fft/fft.h>
 #include <string>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include "convert_kernels.h"
 
 #define GRSQL_UNKNOWN 0
 #define GRSQL_SELECT 1
 #define GRSQL_INSERT 2
 
+#define SELECT_UNKNOWN 0
+#define SELECT_STAR 1
+#define SELECT_I 2
+#define SELECT_Q 3
+#define SELECT_TIMELENGTH 4
+#define SELECT_CONSTELLATION 5
+#define SELECT_HEALTH 6
+
+// Not a flowgraph type: the instance is driven by the sqlquery API
+#define DATATYPE_QUERY -1
 #define DATATYPE_UNKNOWN 0
 #define DATATYPE_COMPLEX 1
 #define DATATYPE_FLOAT 2
@@ -38,21 +58,140 @@
 #define DATATYPE_SIGNED8 6
 // RTL_SDR
 #define DATATYPE_UNSIGNED8 7
+// UHD / BladeRF interleaved int16 I/Q
+#define DATATYPE_SC16 8
+// Packed 12-bit I/Q (3 bytes per complex sample)
+#define DATATYPE_SC12 9
+// UHD interleaved int8 I/Q
+#define DATATYPE_SC8 10
 
 #define FILEREADBLOCKSIZE 1024000
+// Largest interpolation or decimation factor we'll build a polyphase filter for
+#define MAXRESAMPLEFACTOR 1024
+// CENTER / CHANNELS AT: output rate is at least this times the BANDWIDTH so the low pass
+// has room to stop before anything aliases back into the channel
+#define CHANNELOVERSAMPLE 1.25
+
+// Max digits after the decimal point kept when converting a time to a sample number
+#define MAXTIMEDECIMALS 12
+
+// REALTIME pacing
+// default chunk is 10 ms of samples
+#define REALTIMEDEFAULTCHUNKSEC 0.01
+// sleep to just short of the deadline then spin the rest
+#define REALTIMESPINUS 200
+// falling more than this many chunks behind counts as an underrun and restarts the clock
+#define REALTIMEMAXLATECHUNKS 2
+
+// FOLLOW
+// grsql gives up on a recording that hasn't grown for this long (IDLE overrides, the block waits forever)
+#define FOLLOWDEFAULTIDLESEC 10.0
+// Where inotify isn't available the file size is checked this often
+#define FOLLOWPOLLMS 50
+// A waiting block wakes up this often to see if the flowgraph is stopping
+#define FOLLOWWAKEMS 100
+
+// grsql --serve keeps at most this many parsed sidecars
+#define SIDECARCACHEMAX 1024
+
+// WHERE MATCHES
+// Overlap-save FFT is at least this big and at least 4x the template
+#define MATCHMINFFTSIZE 4096
+#define MATCHMAXTEMPLATE 1048576
+// Work is split into this many chunks per thread so uneven chunks even out
+#define MATCHCHUNKSPERTHREAD 4
+// How often the block checks on the search started in start()
+#define MATCHWAITMS 50
+
+// SELECT CONSTELLATION
+#define CONSTELLATIONDEFAULTBINS 256
+#define CONSTELLATIONMAXBINS 4096
+// RANGE AUTO looks at this many samples from the start of the range
+#define CONSTELLATIONAUTOSAMPLES 1048576
+// Per-thread counts are 32-bit, so chunks stay well under 4G samples
+#define CONSTELLATIONMAXCHUNK 67108864
+
+// SELECT HEALTH
+// Dropouts are runs of at least this many all-zero samples
+#define HEALTHDEFAULTMINDROPOUT 16
+// Clipped / NaN samples closer than this are reported as one range
+#define HEALTHDEFAULTMERGEGAP 1024
 
 namespace gr {
   namespace sql {
 
+    // A WHERE MATCHES detection: template start sample and normalized correlation (0-1)
+    struct match_hit
+    {
+    	int64_t sample;
+    	double score;
+    	int64_t outsample;  // where it lands in the output (windows only)
+    };
+
+    // Output window around one or more detections, [start, end) in samples
+    struct match_window
+    {
+    	int64_t start;
+    	int64_t end;
+    	int64_t outsample;
+    };
+
+    // A SigMF annotation picked by WHERE ANNOTATION LABEL = '...'
+    struct sigmf_annotation
+    {
+    	int64_t start;
+    	int64_t count;      // -1 = to the end of the recording
+    	std::string label;
+    	int64_t outsample;  // where its first sample lands in the output (or its own file)
+    	size_t window;      // match_window it was written in
+    };
+
+    // A parsed SigMF sidecar
+    struct sidecar_info
+    {
+    	int dtype;             // DATATYPE_UNKNOWN if it doesn't say
+    	long rate;             // 0 if it doesn't say
+    	bool hasannotations;   // annotations was filled in
+    	std::vector<sigmf_annotation> annotations;
+    };
+
+    // A SELECT HEALTH finding: [start, end) in samples, count = flagged samples in it
+    struct health_range
+    {
+    	int type;  // HEALTH_CLIPPED, HEALTH_ZERO or HEALTH_NONFINITE
+    	int64_t start;
+    	int64_t end;
+    	int64_t count;
+    };
+
+    // One SHARD INTO piece, in samples.  [corestart, end) is what the shard owns;
+    // [readstart, corestart) is the OVERLAP lead-in taken from the previous shard.
+    struct shard_range
+    {
+    	int64_t readstart;
+    	int64_t corestart;
+    	int64_t end;
+    	std::string file;
+    };
+
+    template <class T> class stream_filter;
+    class file_reader;
+    class file_writer;
+    class fft_filterbank;
+
     class SQL_API sqlsource_impl : public sqlsource
     {
+     friend class sqlquery_impl;
+
      protected:
     	std::string sqlstring;
 
     	int sqlAction;  // select or insert
     	int selectAction; // *, I, Q, TIMELENGTH, etc.
     	std::string filename;
-		FILE * pInputFile;
+		file_reader * pInputFile;
+		int iopolicy;
+		long readahead;   // 0 = default window
 
         boost::mutex fp_mutex;
 
@@ -60,31 +199,201 @@ namespace gr {
     	bool hasOutputFile;
 
     	int grcdatatype; // set in flowgraph
+    	int vlen;        // output vector length (VLEN)
+
+    	// grsql and the flowgraph exit on an ERROR.  The query API (and a JOIN's second
+    	// source) throws instead so a bad query raises in Python rather than killing it.
+    	bool throwerrors;
+    	bool setupdone;    // parse / setup errors are std::invalid_argument, later ones std::runtime_error
+    	std::ostringstream errormessage;
 
     	int dataType; // defined in SQL
     	long samplerate;
-    	float starttime;
-    	float endtime;
+    	double outputrate;  // after any RESAMPLE / DECIMATE / CENTER
+    	int64_t startsample;
+    	int64_t endsample;   // exclusive, -1 = end of file
 
 		long filesize;
 		int datatypesize;
 		long numdatapoints;
-		float numsec;
+		double numsec;
 
 		unsigned char buffer[FILEREADBLOCKSIZE];
+		// Picked once for this (data type, SELECT).  NULL reads straight into the output.
+		convert_kernel convert;
 		long curfileposition;
 		long endfileposition;
 
+		// RESAMPLE TO / DECIMATE
+		long resampletorate;
+		long decimation;
+		int resampletaps; // 0 = auto
+		// CENTER / BANDWIDTH and CHANNELS AT
+		bool hascenter;
+		double centerfreq;
+		double bandwidth;
+		std::vector<double> channelcenters;
+		fft_filterbank *filterbank;
+
+		// Whichever of the above is in use sits between ReadItems() and the output
+		stream_filter<gr_complex> *cfilter;
+		stream_filter<float> *ffilter;
+		std::vector<unsigned char> filterbuffer;
+
+		// SHARD INTO n [OVERLAP m]
+		int shardcount;
+		int64_t shardoverlap;
+
+		// JOIN '<file>' ON TIME OFFSET <dt>.  The second recording is read through its own
+		// instance, in lockstep with this one, onto output 1.
+		std::string joinfile;
+		std::string joinoptions;  // ASDATATYPE / SAMPLERATE given for the joined file
+		std::string joinoffset;
+		bool joinoffsetnegative;
+		bool joininterleave;      // command-line: one interleaved file instead of two
+		std::unique_ptr<sqlsource_impl> joined;
+
+		// WHERE MATCHES '<template>' THRESHOLD x [WINDOW before,after]
+		std::string matchfile;
+		double matchthreshold;
+		int64_t matchbefore;
+		int64_t matchafter;
+		std::vector<gr_complex> matchtemplate;
+		double matchtemplatenorm;
+		int matchfftsize;
+		std::vector<gr_complex> matchspectrum;  // conj(FFT(template)), zero padded to matchfftsize
+		std::vector<match_hit> matches;
+		std::vector<match_window> matchwindows;
+		size_t curmatchwindow;
+		size_t nextmatchtag;
+		// The block searches on its own thread from start() so work() (and fp_mutex) isn't
+		// tied up for the whole scan and stop() can cancel it
+		std::thread matchsearch;
+		std::vector< std::unique_ptr<file_reader> > matchreaders;  // opened before the search thread starts
+		std::atomic<bool> matchcancel;
+		std::atomic<bool> matchfailed;  // the search couldn't read the file (logged), nothing to play
+		std::atomic<bool> matchready;   // matches / matchwindows are complete
+
+		// WHERE ANNOTATION LABEL = '<label>' [PAD n[S|MS|US]] [SPLIT].  Played through the
+		// same windows as WHERE MATCHES.
+		std::string annotationlabel;
+		int64_t annotationpad;
+		bool annotationsplit;  // one output file per annotation
+		std::vector<sigmf_annotation> annotations;
+		size_t nextannotationtag;
+
+		// SELECT CONSTELLATION [BINS n] [RANGE x]
+		int constellationbins;
+		double constellationrange;  // 0 = AUTO
+
+		// SELECT HEALTH [MINDROPOUT n] [MERGEGAP n]
+		int64_t healthmindropout;
+		int64_t healthmergegap;
+
+		// FOLLOW [LATENCY ms] [IDLE sec]: keep reading as the recorder appends
+		bool follow;
+		int followlatency;   // ms to wait for a full read block once data arrives, 0 = hand it out right away
+		double followidle;   // give up after this long without growth, 0 = never
+		int followfd;        // inotify
+		unsigned long followinode;
+
+		// REALTIME [SPEEDUP x] [CHUNK n]
+		bool realtime;
+		double speedup;
+		long rtchunk;       // max items (vectors) per work() call
+		double rtitemrate;  // items per second after SPEEDUP
+		bool rtstarted;
+		std::chrono::steady_clock::time_point rtstart;     // start of the current pacing epoch
+		std::chrono::steady_clock::time_point rtplaystart; // first output, for overall drift
+		long rtitems;       // items released this epoch
+		long rttotalitems;
+		long rtunderruns;
+		double rtmaxlate;   // seconds
+		double rtdrift;     // seconds behind the ideal clock at the last release
+
+    	void Setup(int dsize);
+    	void Release();
+    	std::ostream &ErrorOut();
+    	void ErrorExit();
     	void parsesql(bool ignore_nosaveas=false);
     	long GetFileSize(std::string filename);
     	int GetDataTypeSize();
+    	bool IsPackedComplex();
+    	int64_t TimeToSample(std::string stime);
+
+    	void OpenInputFile();
+    	void AlignToVectors(long &startpos, long &endpos);
+    	void GetFileRange(long &startpos, long &endpos);
+    	void CopyRange(file_reader *reader, file_writer *writer, long startpos, long endpos);
+    	int ReadItems(int noutput_items, void *output);
+    	int ReadVectors(int nvectors, void *output);
+    	int GetOutputItemSize();
+    	void SetSchedulerHints(int dsize);
+    	void SetupRealtime();
+    	bool FollowFile();
+    	void PaceOutput(long nitems);
+
+    	void SetupFilters();
+    	int SaveFiltered();
+    	int SaveChannels();
+    	int SaveShards();
+    	bool WriteShard(file_reader &reader, const shard_range &shard);
+    	void WriteShardManifest(std::ostream &out, const std::vector<shard_range> &shards);
+    	void SplitOutputFileName(std::string &base, std::string &ext);
+    	bool OpenWorkerReaders(int count, std::vector< std::unique_ptr<file_reader> > &readers);
+    	long ReadSamples(file_reader &reader, long nsamples, std::vector<unsigned char> &raw, std::vector<unsigned char> &converted, gr_complex *out);
+    	int SaveConstellation();
+    	int SaveHealth();
+    	bool HealthChunk(file_reader &reader, int64_t chunkstart, int64_t chunkend, std::vector<health_range> &found);
+    	void WriteHealthReport(std::ostream &out, int64_t nsamples, const std::vector<health_range> &found);
+    	void LoadMatchTemplate();
+    	bool SearchMatches(std::vector< std::unique_ptr<file_reader> > &readers, std::string &failure);
+    	void StartMatchSearch();
+    	bool SearchChunk(file_reader &reader, gr::fft::fft_complex_fwd &fwdfft, gr::fft::fft_complex_rev &revfft, int64_t chunkstart, int64_t chunkend, int64_t rangeend, std::vector<match_hit> &hits);
+    	void BuildMatchWindows();
+    	void SeekMatchWindow(size_t w);
+    	int ReadMatchWindows(int noutput_items, void *output);
+    	int SaveMatches();
+    	void WriteMatchManifest(std::ostream &out);
+    	void LoadAnnotations();
+    	void BuildAnnotationWindows();
+    	int SaveAnnotations();
+    	void WriteAnnotationManifest(std::ostream &out, const std::vector<std::string> &outfiles);
+    	static bool ReadSidecarAnnotations(std::string datafile, std::vector<sigmf_annotation> &found);
+    	static bool LoadSidecar(std::string datafile, bool annotations, sidecar_info &info);
+    	static void ParseSidecarAnnotations(const std::string &text, std::vector<sigmf_annotation> &found);
+    	void SetupJoin();
+    	void OpenJoinedFile();
+    	int SaveJoined();
+    	static std::string DataTypeName(int dtype);
+    	static std::string JsonQuoted(const std::string &str);
+    	int GetChannelDecimation(bool powerof2);
+    	bool IsComplexOutput();
+    	template <class T> int ReadFiltered(stream_filter<T> *filter, int noutput_items, T *out);
 
      public:
-      sqlsource_impl(const char * csqlstring, int igrcdatatype=DATATYPE_UNKNOWN,int dsize=8 ); // used for command-line
+      // Shared with sqlsink
+      static long ParseRate(std::string srate);
+      static double ParseFrequency(std::string sfreq);
+      // SigMF style sidecar metadata (name.sigmf-meta next to the data file)
+      static std::string SidecarFileName(std::string datafile);
+      static std::string SigMFDataType(int dtype);
+      static int DataTypeFromSigMF(std::string sigmftype);
+      static bool ReadSidecar(std::string datafile, int &dtype, long &rate);
+      // grsql --serve: keep parsed sidecars in this process (rechecked against each sidecar's
+      // inode / size / mtime on use) and fill them in for a query's files ahead of the fork
+      static void CacheSidecars(bool enable);
+      static void PrimeSidecars(std::string sqlstring, std::string cwd);
+
+      sqlsource_impl(const char * csqlstring, int igrcdatatype=DATATYPE_UNKNOWN,int dsize=8, int ivlen=1 ); // used for command-line
       ~sqlsource_impl();
 
+      bool start();
       bool stop();
 
+      long underruns() { return rtunderruns; }
+      double drift() { return rtdrift; }
+
       int runsql();
 
       // Where all the action really happens
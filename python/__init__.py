@@ -21,3 +21,34 @@ except ModuleNotFoundError:
 
 # import any pure python here
 #
+
+def query_chunks(sqlstring, chunk_items=1048576):
+    '''
+    Run a SELECT and yield the result as numpy arrays of up to chunk_items
+    samples.  When the query needs no conversion the arrays are read-only
+    views of the memory mapped file.
+    '''
+    q = sqlquery(sqlstring)
+    while True:
+        chunk = q.read(chunk_items)
+        if len(chunk) == 0:
+            break
+        yield chunk
+
+
+def query(sqlstring):
+    '''
+    Run a SELECT and return the whole result as one numpy array.
+    '''
+    import numpy
+
+    q = sqlquery(sqlstring)
+    if q.zero_copy():
+        return q.read(q.num_items())
+
+    chunks = [q.read(q.estimated_output_items())]
+    while len(chunks[-1]) > 0:
+        chunks.append(q.read(1048576))
+
+    return numpy.concatenate(chunks)
+
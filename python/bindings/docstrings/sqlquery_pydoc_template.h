@@ -0,0 +1,51 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ */
+#include "pydoc_macros.h"
+#define D(...) DOC(gr,sql, __VA_ARGS__ )
+/*
+  This file contains placeholders for docstrings for the Python bindings.
+  Do not edit! These were automatically extracted during the binding process
+  and will be overwritten during the build process
+ */
+
+
+ 
+ static const char *__doc_gr_sql_sqlquery = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_make = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_dtype = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_itemsize = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_vlen = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_sample_rate = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_num_items = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_estimated_output_items = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_zero_copy = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_map = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlquery_read = R"doc()doc";
+
+  
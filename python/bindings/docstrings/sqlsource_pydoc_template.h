@@ -24,4 +24,10 @@
 
  static const char *__doc_gr_sql_sqlsource_make = R"doc()doc";
 
+
+ static const char *__doc_gr_sql_sqlsource_underruns = R"doc()doc";
+
+
+ static const char *__doc_gr_sql_sqlsource_drift = R"doc()doc";
+
   
@@ -22,6 +22,8 @@ namespace py = pybind11;
 /**************************************/
 // BINDING_FUNCTION_PROTOTYPES(
     void bind_sqlsource(py::module& m);
+    void bind_sqlquery(py::module& m);
+    void bind_sqlsink(py::module& m);
 // ) END BINDING_FUNCTION_PROTOTYPES
 
 
@@ -51,5 +53,7 @@ PYBIND11_MODULE(sql_python, m)
     /**************************************/
     // BINDING_FUNCTION_CALLS(
     bind_sqlsource(m);
+    bind_sqlquery(m);
+    bind_sqlsink(m);
     // ) END BINDING_FUNCTION_CALLS
 }
\ No newline at end of file
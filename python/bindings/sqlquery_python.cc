@@ -0,0 +1,116 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ */
+
+/***********************************************************************************/
+/* This file is automatically generated using bindtool and can be manually edited  */
+/* The following lines can be configured to regenerate this file during cmake      */
+/* If manual edits are made, the following tags should be modified accordingly.    */
+/* BINDTOOL_GEN_AUTOMATIC(0)                                                       */
+/* BINDTOOL_USE_PYGCCXML(0)                                                        */
+/* BINDTOOL_HEADER_FILE(sqlquery.h)                                        */
+/* BINDTOOL_HEADER_FILE_HASH(b7b82a5197b43f3ddc2a9614745d42c8)                     */
+/***********************************************************************************/
+
+#include <pybind11/complex.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/numpy.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include <sql/sqlquery.h>
+// pydoc.h is automatically generated in the build directory
+#include <sqlquery_pydoc.h>
+
+// Returns a numpy array of up to nitems samples (fewer at the end, empty when done).
+// Zero-copy queries hand back a read-only view of the mapped file that keeps the
+// mapping alive; everything else is converted into a new array.
+static py::array sqlquery_read(std::shared_ptr<::gr::sql::sqlquery> q, long nitems)
+{
+    py::dtype dt(q->dtype());
+    int vlen = q->vlen();
+    py::array result;
+
+    if (nitems < 0)
+        nitems = 0;
+
+    if (q->zero_copy()) {
+        std::shared_ptr<const void> view;
+        {
+            py::gil_scoped_release release;
+            view = q->map(nitems);
+        }
+
+        if (nitems > 0) {
+            auto keepalive = new std::shared_ptr<const void>(view);
+            py::capsule owner(keepalive, [](void* p) {
+                delete reinterpret_cast<std::shared_ptr<const void>*>(p);
+            });
+
+            result = py::array(dt, { (py::ssize_t)nitems }, { (py::ssize_t)q->itemsize() }, view.get(), owner);
+            result.attr("setflags")(py::arg("write") = false);
+        } else {
+            result = py::array(dt, { (py::ssize_t)0 });
+        }
+    } else {
+        result = py::array(dt, { (py::ssize_t)nitems });
+        void* dest = result.mutable_data();
+        long n;
+        {
+            py::gil_scoped_release release;
+            n = q->read(dest, nitems);
+        }
+
+        if (n < nitems) {
+            py::object trimmed = result[py::slice(0, n, 1)];
+            result = py::array(trimmed);
+        }
+        nitems = n;
+    }
+
+    if (vlen > 1) {
+        py::object shaped = result.attr("reshape")(nitems / vlen, vlen);
+        result = py::array(shaped);
+    }
+
+    return result;
+}
+
+void bind_sqlquery(py::module& m)
+{
+
+    using sqlquery    = ::gr::sql::sqlquery;
+
+
+    py::class_<sqlquery,
+        std::shared_ptr<sqlquery>>(m, "sqlquery", D(sqlquery))
+
+        .def(py::init(&sqlquery::make),
+           py::arg("sqlstring"),
+           D(sqlquery,make)
+        )
+
+        .def("dtype", &sqlquery::dtype, D(sqlquery,dtype))
+        .def("itemsize", &sqlquery::itemsize, D(sqlquery,itemsize))
+        .def("vlen", &sqlquery::vlen, D(sqlquery,vlen))
+        .def("sample_rate", &sqlquery::sample_rate, D(sqlquery,sample_rate))
+        .def("num_items", &sqlquery::num_items, D(sqlquery,num_items))
+        .def("estimated_output_items", &sqlquery::estimated_output_items, D(sqlquery,estimated_output_items))
+        .def("zero_copy", &sqlquery::zero_copy, D(sqlquery,zero_copy))
+
+        .def("read", &sqlquery_read,
+           py::arg("nitems"),
+           D(sqlquery,read)
+        )
+
+        ;
+
+
+
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright 2020 Free Software Foundation, Inc.
+ *
+ * This file is part of GNU Radio
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *
+ */
+
+/***********************************************************************************/
+/* This file is automatically generated using bindtool and can be manually edited  */
+/* The following lines can be configured to regenerate this file during cmake      */
+/* If manual edits are made, the following tags should be modified accordingly.    */
+/* BINDTOOL_GEN_AUTOMATIC(0)                                                       */
+/* BINDTOOL_USE_PYGCCXML(0)                                                        */
+/* BINDTOOL_HEADER_FILE(sqlsink.h)                                        */
+/* BINDTOOL_HEADER_FILE_HASH(0ce47d9b341e142b3c7977bce95fd3a2)                     */
+/***********************************************************************************/
+
+#include <pybind11/complex.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+namespace py = pybind11;
+
+#include <sql/sqlsink.h>
+// pydoc.h is automatically generated in the build directory
+#include <sqlsink_pydoc.h>
+
+void bind_sqlsink(py::module& m)
+{
+
+    using sqlsink    = ::gr::sql::sqlsink;
+
+
+    py::class_<sqlsink, gr::sync_block, gr::block, gr::basic_block,
+        std::shared_ptr<sqlsink>>(m, "sqlsink", D(sqlsink))
+
+        .def(py::init(&sqlsink::make),
+           py::arg("sqlstring"),
+           py::arg("igrcdatatype"),
+           py::arg("vlen") = 1,
+           D(sqlsink,make)
+        )
+
+        .def("dropped", &sqlsink::dropped, D(sqlsink,dropped))
+        .def("recorded", &sqlsink::recorded, D(sqlsink,recorded))
+        
+
+
+
+        ;
+
+
+
+
+}
+
+
+
+
+
+
+
+
@@ -14,7 +14,7 @@
 /* BINDTOOL_GEN_AUTOMATIC(0)                                                       */
 /* BINDTOOL_USE_PYGCCXML(0)                                                        */
 /* BINDTOOL_HEADER_FILE(sqlsource.h)                                        */
-/* BINDTOOL_HEADER_FILE_HASH(e2ac450377b85fc252be20672c75b6e6)                     */
+/* BINDTOOL_HEADER_FILE_HASH(0da0fc591e9ac6e39699561586f1b793)                     */
 /***********************************************************************************/
 
 #include <pybind11/complex.h>
@@ -39,8 +39,12 @@ void bind_sqlsource(py::module& m)
         .def(py::init(&sqlsource::make),
            py::arg("sqlstring"),
            py::arg("igrcdatatype"),
+           py::arg("vlen") = 1,
            D(sqlsource,make)
         )
+
+        .def("underruns", &sqlsource::underruns, D(sqlsource,underruns))
+        .def("drift", &sqlsource::drift, D(sqlsource,drift))
         
 
 
@@ -0,0 +1,114 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Copyright 2017 ghostop14.
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+from gnuradio import gr_unittest
+import numpy
+import os
+import shutil
+import tempfile
+import sql
+
+NSAMPLES = 10000
+
+
+class qa_sqlquery(gr_unittest.TestCase):
+
+    def setUp(self):
+        self.tmpdir = tempfile.mkdtemp()
+        rng = numpy.random.default_rng(1)
+
+        self.complexfile = os.path.join(self.tmpdir, 'samples.raw')
+        data = (rng.standard_normal(NSAMPLES) + 1j * rng.standard_normal(NSAMPLES)).astype(numpy.complex64)
+        data.tofile(self.complexfile)
+
+        # Interleaved I/Q, with full scale at both ends in there
+        self.sc16file = os.path.join(self.tmpdir, 'samples.sc16')
+        iq = rng.integers(-32768, 32768, size=2 * NSAMPLES, dtype=numpy.int16)
+        iq[0:4] = [32767, -32768, 0, -1]
+        iq.tofile(self.sc16file)
+
+    def tearDown(self):
+        shutil.rmtree(self.tmpdir)
+
+    def complex_sql(self, where='STARTATSAMPLE 0'):
+        return "SELECT * FROM '%s' ASDATATYPE complex SAMPLERATE 1M %s" % (self.complexfile, where)
+
+    def sc16_sql(self, where='STARTATSAMPLE 0'):
+        return "SELECT * FROM '%s' ASDATATYPE SC16 SAMPLERATE 1M %s" % (self.sc16file, where)
+
+    def sc16_expected(self):
+        iq = numpy.fromfile(self.sc16file, dtype=numpy.int16).astype(numpy.float32) / 32767.0
+        return (iq[0::2] + 1j * iq[1::2]).astype(numpy.complex64)
+
+    def test_001_complex(self):
+        expected = numpy.fromfile(self.complexfile, dtype=numpy.complex64)
+
+        q = sql.sqlquery(self.complex_sql())
+        self.assertTrue(q.zero_copy())
+        self.assertEqual(q.dtype(), 'complex64')
+        self.assertEqual(q.num_items(), NSAMPLES)
+
+        result = sql.query(self.complex_sql())
+        self.assertEqual(result.dtype, numpy.complex64)
+        numpy.testing.assert_array_equal(result, expected)
+
+        # ENDATSAMPLE is exclusive
+        result = sql.query(self.complex_sql('STARTATSAMPLE 100 ENDATSAMPLE 300'))
+        numpy.testing.assert_array_equal(result, expected[100:300])
+
+        result = sql.query("SELECT Q FROM '%s' ASDATATYPE complex SAMPLERATE 1M STARTATSAMPLE 0" % self.complexfile)
+        self.assertEqual(result.dtype, numpy.float32)
+        numpy.testing.assert_array_equal(result, expected.imag)
+
+    def test_002_sc16(self):
+        expected = self.sc16_expected()
+
+        q = sql.sqlquery(self.sc16_sql())
+        self.assertFalse(q.zero_copy())
+        self.assertEqual(q.dtype(), 'complex64')
+
+        result = sql.query(self.sc16_sql())
+        self.assertEqual(len(result), NSAMPLES)
+        numpy.testing.assert_allclose(result, expected, rtol=0, atol=1e-6)
+        self.assertAlmostEqual(result[0].real, 1.0, places=6)
+        self.assertLess(result[0].imag, -1.0)
+
+        result = sql.query(self.sc16_sql('STARTATSAMPLE 5000 ENDATSAMPLE 5123'))
+        numpy.testing.assert_allclose(result, expected[5000:5123], rtol=0, atol=1e-6)
+
+    def test_003_chunks(self):
+        # Chunk size that doesn't divide the file, for both the mapped and converted paths
+        for sqlstring in (self.complex_sql(), self.sc16_sql()):
+            whole = sql.query(sqlstring)
+            chunks = list(sql.query_chunks(sqlstring, 777))
+
+            self.assertEqual([len(c) for c in chunks[:-1]], [777] * (len(chunks) - 1))
+            self.assertGreater(len(chunks[-1]), 0)
+            numpy.testing.assert_array_equal(numpy.concatenate(chunks), whole)
+
+    def test_004_bad_query(self):
+        with self.assertRaises(ValueError):
+            sql.query("SELECT * FORM '%s' ASDATATYPE complex SAMPLERATE 1M STARTATSAMPLE 0" % self.complexfile)
+
+        with self.assertRaises(ValueError):
+            sql.query("SELECT * FROM '%s' ASDATATYPE NOTATYPE SAMPLERATE 1M STARTATSAMPLE 0" % self.complexfile)
+
+        with self.assertRaises(ValueError):
+            sql.query("SELECT * FROM '%s' ASDATATYPE complex SAMPLERATE 1M STARTATSAMPLE 0"
+                      % os.path.join(self.tmpdir, 'missing.raw'))
+
+    def test_005_past_end(self):
+        with self.assertRaises(ValueError):
+            sql.query(self.complex_sql('STARTATSAMPLE %d' % NSAMPLES))
+
+        with self.assertRaises(ValueError):
+            sql.query(self.sc16_sql('STARTTIME 0.5'))
+
+
+if __name__ == '__main__':
+    gr_unittest.run(qa_sqlquery)
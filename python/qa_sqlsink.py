@@ -0,0 +1,86 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+#
+# Copyright 2017 ghostop14.
+#
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+
+from gnuradio import gr, gr_unittest, blocks
+import glob
+import json
+import numpy
+import os
+import shutil
+import tempfile
+import sql
+
+NSAMPLES = 110000
+# 25000 SC16 samples per file, so four full files and a short one
+ROLLBYTES = 100000
+SAMPLESPERFILE = ROLLBYTES // 4
+
+
+class qa_sqlsink(gr_unittest.TestCase):
+
+    def setUp(self):
+        self.tb = gr.top_block()
+        self.tmpdir = tempfile.mkdtemp()
+
+    def tearDown(self):
+        self.tb = None
+        shutil.rmtree(self.tmpdir)
+
+    def test_001_sc16_roll_round_trip(self):
+        rng = numpy.random.default_rng(2)
+        data = (rng.uniform(-0.9, 0.9, NSAMPLES) + 1j * rng.uniform(-0.9, 0.9, NSAMPLES)).astype(numpy.complex64)
+        # Full scale both ways
+        data[0] = 1.0 - 1.0j
+
+        filename = os.path.join(self.tmpdir, 'capture.sc16')
+        src = blocks.vector_source_c(data.tolist(), False)
+        # Input type 1 is complex (see the GRC block)
+        snk = sql.sqlsink("INSERT INTO '%s' ASDATATYPE SC16 SAMPLERATE 1M ROLL EVERY %d" % (filename, ROLLBYTES), 1, 1)
+        self.tb.connect(src, snk)
+        self.tb.run()
+
+        self.assertEqual(snk.recorded(), NSAMPLES)
+        self.assertEqual(snk.dropped(), 0)
+
+        files = sorted(glob.glob(os.path.join(self.tmpdir, 'capture_*.sc16')))
+        self.assertEqual([os.path.basename(f) for f in files],
+                         ['capture_%04d.sc16' % n for n in range((NSAMPLES + SAMPLESPERFILE - 1) // SAMPLESPERFILE)])
+
+        readback = []
+        nextindex = 0
+
+        for f in files:
+            with open(os.path.splitext(f)[0] + '.sigmf-meta') as meta:
+                sidecar = json.load(meta)
+
+            self.assertEqual(sidecar['global']['core:datatype'], 'ci16_le')
+            # No drops, so one capture segment that picks up where the last file ended
+            self.assertEqual(len(sidecar['captures']), 1)
+            self.assertEqual(sidecar['captures'][0]['core:sample_start'], 0)
+            self.assertEqual(sidecar['captures'][0]['core:global_index'], nextindex)
+
+            # Type and rate come from the sidecar
+            q = sql.sqlquery("SELECT * FROM '%s' STARTATSAMPLE 0" % f)
+            self.assertEqual(q.sample_rate(), 1e6)
+
+            samples = sql.query("SELECT * FROM '%s' STARTATSAMPLE 0" % f)
+            self.assertEqual(len(samples), min(SAMPLESPERFILE, NSAMPLES - nextindex))
+
+            readback.append(samples)
+            nextindex = nextindex + len(samples)
+
+        self.assertEqual(nextindex, NSAMPLES)
+
+        # Rounded to the nearest of 32767 steps on the way in
+        readback = numpy.concatenate(readback)
+        numpy.testing.assert_allclose(readback, data, rtol=0, atol=1.0 / 32767)
+        self.assertEqual(readback[0], 1.0 - 1.0j)
+
+
+if __name__ == '__main__':
+    gr_unittest.run(qa_sqlsink)